@@ -0,0 +1,116 @@
+
+// Compare two-pass marshaling (xdr_to_msg, which sizes the values
+// before marshaling them) with single-pass marshaling into a growable
+// buffer (xdr_to_msg_grow).  Not run by "make check"; run it by hand:
+//
+//   ./tests/bench-marshal [iteration-scale]
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <xdrpp/marshal.h>
+#include "tests/xdrtest.hh"
+
+using namespace std;
+using namespace xdr;
+using namespace testns;
+
+template<typename F> double
+ns_per_op(size_t iters, F &&f)
+{
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < iters; i++)
+    f();
+  chrono::duration<double, nano> d = chrono::steady_clock::now() - start;
+  return d.count() / iters;
+}
+
+template<typename T> void
+bench(const char *name, const T &t, size_t iters)
+{
+  msg_ptr a = xdr_to_msg(t), b = xdr_to_msg_grow(t);
+  assert(a->size() == b->size());
+  assert(!memcmp(a->raw_data(), b->raw_data(), a->raw_size()));
+
+  volatile size_t sink = 0;
+  double size = ns_per_op(iters, [&]() {
+      sink = sink + xdr_argpack_size(t);
+    });
+  double twopass = ns_per_op(iters, [&]() {
+      sink = sink + xdr_to_msg(t)->size();
+    });
+  double onepass = ns_per_op(iters, [&]() {
+      sink = sink + xdr_to_msg_grow(t)->size();
+    });
+
+  cout << left << setw(22) << name << right << setw(9) << a->size()
+       << fixed << setprecision(1)
+       << setw(12) << size << setw(12) << twopass << setw(12) << onepass
+       << setw(9) << setprecision(2) << twopass / onepass << "x" << endl;
+}
+
+test_recursive
+make_tree(int depth, int fanout)
+{
+  test_recursive t;
+  t.elem = "node at depth " + to_string(depth);
+  if (depth > 0) {
+    for (int i = 0; i < fanout; i++)
+      t.nextvec.push_back(make_tree(depth - 1, fanout));
+    t.next.activate() = make_tree(depth - 1, 1);
+  }
+  return t;
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t scale = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1;
+
+  test_recursive tree = make_tree(4, 6);
+
+  xvector<uunion> unions;
+  for (unsigned i = 0; i < 2000; i++) {
+    uunion &u = unions.emplace_back();
+    u.d((i % 4) + 1);
+    switch (u.d()) {
+    case 1: u.one() = i & 1; break;
+    case 2: u.two() = i; break;
+    case 3: u.three() = i / 3.0; break;
+    case 4: u.four() = string(i % 29, 'x'); break;
+    }
+  }
+
+  containertest ct;
+  for (int i = 0; i < 2000; i++) {
+    u_4_12 &u = ct.uvec.emplace_back();
+    if (i & 1)
+      u.which(4).f4().i = i;
+    else
+      u.which(12).f12().i = i;
+  }
+  ct.sarr[0] = "first";
+  ct.sarr[1] = "second";
+
+  hasbytes hb;
+  for (int i = 0; i < 1000; i++) {
+    bytes &b = hb.the_bytes.emplace_back();
+    b.s = "abc";
+    b.variable.resize(i % 17);
+  }
+
+  numerics n {true, -1, 2, -3, 4, 5.0, 6.0, testns::REDDER};
+
+  cout << left << setw(22) << "type" << right << setw(9) << "bytes"
+       << setw(12) << "size ns" << setw(12) << "2-pass ns"
+       << setw(12) << "1-pass ns" << setw(10) << "speedup" << endl;
+  bench("test_recursive tree", tree, 2000 * scale);
+  bench("xvector<uunion>", unions, 2000 * scale);
+  bench("containertest", ct, 2000 * scale);
+  bench("hasbytes", hb, 2000 * scale);
+  bench("numerics", n, 2000000 * scale);
+  return 0;
+}
@@ -0,0 +1,216 @@
+
+// Measure the cost of a pollset wakeup with one busy socket and a
+// growing number of idle ones, for each backend, and the rate at
+// which a server thread can echo small messages over loopback.  Not
+// run by "make check"; run it by hand:
+//
+//   ./tests/bench-pollset [iterations]
+//
+// Each idle socket is a single unbound datagram socket, so it costs
+// one descriptor and is never ready.  The number of idle sockets is
+// limited by RLIMIT_NOFILE, which the benchmark raises to its hard
+// limit; the last row is clamped to what fits, and larger counts are
+// skipped.  With a hard limit of 20000, for instance, the run stops
+// at 19984 idle sockets rather than 50000; raise the hard limit
+// (e.g., "ulimit -Hn 65536" as root) to cover the full range.
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <xdrpp/msgsock.h>
+#include <xdrpp/pollset.h>
+
+using namespace std;
+using namespace xdr;
+
+using backend = pollset::backend;
+
+size_t
+max_fds()
+{
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+    perror("getrlimit");
+    exit(1);
+  }
+  if (rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+  }
+  return rl.rlim_cur;
+}
+
+// Nanoseconds per round trip of one byte through a socket pair while
+// nidle other sockets are registered but never ready.
+double
+bench(backend b, size_t nidle, size_t iters)
+{
+  pollset ps(b);
+  vector<int> idle;
+  for (size_t i = 0; i < nidle; i++) {
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd == -1) {
+      perror("socket");
+      exit(1);
+    }
+    idle.push_back(fd);
+    ps.fd_cb(fd, pollset::Read, []() { assert(!"idle socket ready"); });
+  }
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    exit(1);
+  }
+  size_t n = 0;
+  ps.fd_cb(fds[0], pollset::Read, [&]() {
+      char c;
+      if (read(fds[0], &c, 1) == 1)
+	++n;
+    });
+
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < iters; i++) {
+    if (write(fds[1], "x", 1) != 1) {
+      perror("write");
+      exit(1);
+    }
+    while (n <= i)
+      ps.poll();
+  }
+  chrono::duration<double, nano> d = chrono::steady_clock::now() - start;
+
+  ps.fd_cb(fds[0], pollset::Read);
+  close(fds[0]);
+  close(fds[1]);
+  for (int fd : idle) {
+    ps.fd_cb(fd, pollset::Read);
+    close(fd);
+  }
+  return d.count() / iters;
+}
+
+double
+thread_cpu_seconds()
+{
+  rusage ru;
+  getrusage(RUSAGE_THREAD, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+    + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+struct echo_result {
+  double msgs_per_sec;		// Wall clock
+  double server_cpu_ns;		// Server thread CPU time per message
+};
+
+// A server thread using backend b echoes 40-byte messages on nconn
+// connections, on each of which the client keeps window messages in
+// flight.
+echo_result
+echo(backend b, int nconn, int window, double seconds)
+{
+  vector<int> cfds, sfds;
+  for (int i = 0; i < nconn; i++) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+      perror("socketpair");
+      exit(1);
+    }
+    cfds.push_back(fds[0]);
+    sfds.push_back(fds[1]);
+  }
+
+  atomic<bool> stop {false};
+  double server_cpu = 0;
+  thread server([&]() {
+      pollset ps(b);
+      vector<unique_ptr<msg_sock>> socks;
+      for (int fd : sfds) {
+	msg_sock *ms = new msg_sock(ps, sock_t(fd), nullptr);
+	socks.emplace_back(ms);
+	ms->setrcb([ms](msg_ptr m) { if (m) ms->putmsg(m); });
+      }
+      double start = thread_cpu_seconds();
+      while (!stop)
+	ps.poll(10);
+      server_cpu = thread_cpu_seconds() - start;
+    });
+
+  pollset ps(backend::Epoll);
+  vector<unique_ptr<msg_sock>> socks;
+  size_t count = 0;
+  for (int fd : cfds) {
+    msg_sock *ms = new msg_sock(ps, sock_t(fd), nullptr);
+    socks.emplace_back(ms);
+    ms->setrcb([ms, &count](msg_ptr m) {
+	if (m) {
+	  ++count;
+	  ms->putmsg(m);
+	}
+      });
+    for (int i = 0; i < window; i++) {
+      msg_ptr m = message_t::alloc(40);
+      memset(m->data(), 'e', m->size());
+      ms->putmsg(m);
+    }
+  }
+
+  auto start = chrono::steady_clock::now();
+  chrono::duration<double> d;
+  while ((d = chrono::steady_clock::now() - start).count() < seconds)
+    ps.poll(10);
+  size_t n = count;
+  stop = true;
+  server.join();
+  return { n / d.count(), server_cpu * 1e9 / n };
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t iters = argc > 1 ? strtoul(argv[1], nullptr, 0) : 2000;
+  size_t limit = max_fds() - 16;
+
+  cout << setw(9) << "idle" << setw(14) << "poll ns" << setw(14)
+       << "epoll ns" << setw(10) << "ratio" << endl;
+  for (size_t nidle : { 100, 1000, 5000, 10000, 20000, 50000 }) {
+    bool clamped = nidle > limit;
+    if (clamped)
+      nidle = limit;
+    double p = bench(backend::Poll, nidle, iters);
+    double e = bench(backend::Epoll, nidle, iters);
+    cout << setw(9) << nidle << fixed << setprecision(0) << setw(14) << p
+	 << setw(14) << e << setw(9) << setprecision(1) << p / e << "x" << endl;
+    if (clamped) {
+      cout << "skipping larger counts (RLIMIT_NOFILE is " << limit + 16
+	   << ")" << endl;
+      break;
+    }
+  }
+
+  cout << endl << setw(6) << "conns" << setw(8) << "window";
+  for (const char *name : { "poll", "epoll", "uring" })
+    cout << setw(12) << name << " msg/s" << setw(8) << "ns/msg";
+  cout << endl;
+  for (auto [nconn, window] : { pair{1, 1}, pair{1, 32}, pair{16, 8},
+				pair{256, 4} }) {
+    cout << setw(6) << nconn << setw(8) << window << fixed;
+    for (backend b : { backend::Poll, backend::Epoll, backend::Uring }) {
+      echo_result r = echo(b, nconn, window, 1);
+      cout << setw(18) << setprecision(0) << r.msgs_per_sec
+	   << setw(8) << r.server_cpu_ns;
+    }
+    cout << endl;
+  }
+  return 0;
+}
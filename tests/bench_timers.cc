@@ -0,0 +1,128 @@
+
+// Compare the timing wheel behind pollset timeouts with the
+// std::multimap pollset used to keep them in, for a workload like
+// per-connection idle timers: schedule n timeouts up to a minute out,
+// reschedule each one (as on activity), cancel half, and expire the
+// rest while the clock advances a millisecond at a time.  Time is
+// simulated, so this measures only the data structures.  Not run by
+// "make check"; run it by hand:
+//
+//   ./tests/bench-timers [max-timeouts]
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+#include <xdrpp/pollset.h>
+
+using namespace std;
+using namespace xdr;
+
+constexpr int64_t horizon = 60000;
+
+// The operations pollset used to perform on its multimap.
+struct map_timers {
+  using map_t = multimap<int64_t, function<void()>>;
+  using handle = map_t::iterator;
+  map_t m_;
+
+  explicit map_timers(int64_t) {}
+  handle add(int64_t when, function<void()> &&cb) {
+    return m_.emplace(when, std::move(cb));
+  }
+  void reschedule(handle &h, int64_t when) {
+    auto i = h;
+    h = m_.emplace(when, std::move(i->second));
+    m_.erase(i);
+  }
+  void cancel(handle h) { m_.erase(h); }
+  void expire(int64_t now) {
+    for (auto i = m_.begin(); i != m_.end() && i->first <= now;) {
+      i->second();
+      m_.erase(i++);
+    }
+  }
+};
+
+struct wheel_timers {
+  using handle = detail::timer_wheel::node *;
+  detail::timer_wheel w_;
+
+  explicit wheel_timers(int64_t now) : w_(now) {}
+  handle add(int64_t when, function<void()> &&cb) {
+    return w_.add(when, std::move(cb));
+  }
+  void reschedule(handle &h, int64_t when) { w_.reschedule(h, when); }
+  void cancel(handle h) { w_.cancel(h); }
+  void expire(int64_t now) { w_.expire(now); }
+};
+
+struct result {
+  double add, reschedule, cancel, expire; // Nanoseconds per timeout
+};
+
+template<typename T> result
+bench(size_t n)
+{
+  using clk = chrono::steady_clock;
+  auto ns = [n](clk::time_point start) {
+    return chrono::duration<double, nano>(clk::now() - start).count() / n;
+  };
+  mt19937_64 rng(1);
+  vector<int64_t> when(n);
+  for (auto &w : when)
+    w = 1 + rng() % horizon;
+  size_t fired = 0;
+  result r;
+
+  T t(0);
+  vector<typename T::handle> h(n);
+  auto start = clk::now();
+  for (size_t i = 0; i < n; i++)
+    h[i] = t.add(when[i], [&fired]() { ++fired; });
+  r.add = ns(start);
+
+  start = clk::now();
+  for (size_t i = 0; i < n; i++)
+    t.reschedule(h[i], horizon - when[i] + 1);
+  r.reschedule = ns(start);
+
+  start = clk::now();
+  for (size_t i = 0; i < n; i += 2)
+    t.cancel(h[i]);
+  r.cancel = 2 * ns(start);
+
+  start = clk::now();
+  for (int64_t now = 0; now <= horizon; now++)
+    t.expire(now);
+  r.expire = 2 * ns(start);
+
+  if (fired != n / 2) {
+    cerr << "fired " << fired << " of " << n / 2 << endl;
+    exit(1);
+  }
+  return r;
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t max = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1000000;
+
+  cout << setw(9) << "timeouts" << setw(10) << "" << setw(10) << "add"
+       << setw(10) << "resched" << setw(10) << "cancel" << setw(10)
+       << "expire" << "  (ns per timeout)" << endl;
+  for (size_t n = 1000; n <= max; n *= 10) {
+    result m = bench<map_timers>(n), w = bench<wheel_timers>(n);
+    for (auto [name, r] : { pair{"multimap", m}, pair{"wheel", w} })
+      cout << setw(9) << (r.add == m.add ? to_string(n) : "")
+	   << setw(10) << name << fixed << setprecision(0)
+	   << setw(10) << r.add << setw(10) << r.reschedule
+	   << setw(10) << r.cancel << setw(10) << r.expire << endl;
+  }
+  return 0;
+}
@@ -1,5 +1,6 @@
 
 #include <cassert>
+#include <unordered_set>
 #include "tests/xdrtest.hh"
 
 
@@ -50,6 +51,37 @@ main()
 
   testns::hasbytes hb1, hb2;
   assert(hb1 == hb2);
+
+  // std::hash agrees with operator==
+  std::hash<testns::hasbytes> hh;
+  assert(hh(hb1) == hh(hb2));
+  hb1.the_bytes.emplace_back().s = "hello";
+  hb2.the_bytes.emplace_back().s = "hello";
+  assert(hh(hb1) == hh(hb2));
+  hb2.the_bytes[0].variable.push_back(0);
+  assert(hh(hb1) != hh(hb2));
+
+  ce2 = ce1;
+  assert(std::hash<testns::ContainsEnum>{}(ce1)
+	 == std::hash<testns::ContainsEnum>{}(ce2));
+  ce2.c(RED);
+  ce2.foo() = "hello worle";
+  assert(std::hash<testns::ContainsEnum>{}(ce1)
+	 != std::hash<testns::ContainsEnum>{}(ce2));
+
+  std::unordered_set<testns::uniontest> uts;
+  testns::uniontest ut;
+  uts.insert(ut);
+  ut.key.arbitrary(::REDDEST).big() = {1, 2, 3};
+  uts.insert(ut);
+  ut.ip.activate() = 3;
+  uts.insert(ut);
+  uts.insert(ut);
+  assert(uts.size() == 3);
+  assert(uts.count(ut));
+  ut.ip.activate() = 4;
+  assert(!uts.count(ut));
   
+
   return 0;
 }
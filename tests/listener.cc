@@ -17,6 +17,10 @@ namespace {
 pollset ps;
 }
 
+// Services whose arguments are all bounded get a matching maxmsglen
+static_assert(rpc_max_call_size<xdrtest> == xdr_max_size<rpc_msg> + 16);
+static_assert(rpc_max_call_size<xdrtest2> == 0);
+
 
 class xdrtest2_server {
 public:
@@ -4,11 +4,23 @@
 #include <iostream>
 #include <xdrpp/clear.h>
 #include <xdrpp/depth_checker.h>
+#include <xdrpp/digest.h>
+#include <xdrpp/iovec_put.h>
 #include <xdrpp/marshal.h>
 #include <xdrpp/printer.h>
+#include <xdrpp/rpc_msg.hh>
+#include <xdrpp/server.h>
+#include <xdrpp/stream_get.h>
 
 using namespace std;
 
+// Never defined; declaring it turns on validation of testns enums
+// (see xdr::validate_enum), which test_fixed_size_check relies on to
+// show that unchecked fixed-size decoding still rejects bad tags.
+namespace testns {
+template<typename T> inline void xdr_validate_enum(T);
+}
+
 template<typename T>
 typename std::enable_if<!xdr::xdr_traits<T>::has_fixed_size, std::size_t>::type
 xdr_getsize(const T &t)
@@ -97,6 +109,52 @@ apply_indices(F &&f, T &&t, xdr::indices<I...>, A &&...a) ->
   return f(std::get<I>(std::forward<T>(t))..., std::forward<A>(a)...);
 }
 
+void
+test_max_size()
+{
+  using namespace xdr;
+  static_assert(xdr_max_size<fix_12> == 12);
+  static_assert(xdr_max_size<testns::bytes> == 20 + 16 + 20);
+  static_assert(xdr_max_size<u_4_12> == 16);
+  static_assert(xdr_max_size<uptr> == 12);
+  static_assert(xdr_max_size<std::tuple<int, xstring<5>>> == 16);
+  static_assert(xdr_max_size<xvector<u_4_12, 3>> == 4 + 3*16);
+  static_assert(xdr_max_size<xarray<xstring<1>, 2>> == 16);
+  static_assert(xdr_max_size<pointer<testns::string32>> == 40);
+  static_assert(xdr_max_size<sunion> == 8);
+  static_assert(xdr_max_size<testns::voidu> == 4);
+  static_assert(xdr_has_bounded_size<rpc_msg>);
+  static_assert(!xdr_has_bounded_size<xstring<>>);
+  static_assert(!xdr_has_bounded_size<test_recursive>);
+  static_assert(!xdr_has_bounded_size<testns::nested_cereal_adapter_calls>);
+  static_assert(!xdr_has_bounded_size<testns::uniontest>);
+  static_assert(!xdr_has_bounded_size<testns::containertest1>);
+  static_assert(!xdr_has_bounded_size<xvector<xvector<int>>>);
+  static_assert(!xdr_has_bounded_size<
+		xvector<opaque_vec<0x10000>, 0x10000>>);
+
+  testns::bytes b;
+  b.s = "bounded";
+  b.variable = {1, 2, 3};
+  u_4_12 u;
+  u.which(4).f4().i = 7;
+  msg_ptr m1 = xdr_to_msg(b, u), m2 = xdr_to_msg_bounded(b, u);
+  assert(m1->raw_size() == m2->raw_size());
+  assert(!memcmp(m1->raw_data(), m2->raw_data(), m1->raw_size()));
+
+  // A large bound with a small value must not allocate the bound;
+  // the small result should come from the per-thread cache instead.
+  using big = xvector<std::uint32_t, 0x4000000>;
+  static_assert(xdr_max_size<big> == 4 + 4 * 0x4000000);
+  big v {1, 2, 3};
+  message_pool_stats before = message_t::pool_stats();
+  msg_ptr m3 = xdr_to_msg(v), m4 = xdr_to_msg_bounded(v);
+  message_pool_stats after = message_t::pool_stats();
+  assert(after.hits + after.misses == before.hits + before.misses + 2);
+  assert(m3->size() == 16 && m4->size() == 16);
+  assert(!memcmp(m3->raw_data(), m4->raw_data(), m3->raw_size()));
+}
+
 void
 test_tuple()
 {
@@ -112,6 +170,513 @@ test_tuple()
   assert (foo == bar);
 }
 
+// Marshal a numeric vector or array the slow way, one element at a
+// time, to check that the bulk path produces identical bytes.
+template<typename T> xdr::msg_ptr
+elementwise_msg(const T &t)
+{
+  xdr::msg_ptr m (xdr::message_t::alloc(xdr::xdr_size(t)));
+  xdr::xdr_put p(m);
+  if (xdr::xdr_traits<T>::variable_nelem)
+    p(xdr::size32(t.size()));
+  for (const auto &v : t)
+    p(v);
+  assert(p.p_ == p.e_);
+  return m;
+}
+
+template<typename T> void
+check_numeric_block(const T &t)
+{
+  xdr::msg_ptr ref = elementwise_msg(t);
+  xdr::msg_ptr m = xdr::xdr_to_msg(t);
+  assert(m->size() == ref->size());
+  assert(!memcmp(m->data(), ref->data(), m->size()));
+
+  T u;
+  xdr::xdr_from_msg(m, u);
+  assert(u.size() == t.size());
+  assert(!memcmp(u.data(), t.data(), t.size() * sizeof(t[0])));
+}
+
+void
+test_numeric_blocks()
+{
+  uint64_t seed = 0x9e3779b97f4a7c15;
+  auto next = [&seed]() {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+  };
+
+  // Sizes straddle the 16- and 32-byte SIMD widths to exercise tails.
+  for (size_t n = 0; n < 70; n++) {
+    xdr::xvector<int32_t> vi;
+    xdr::xvector<uint64_t> vu;
+    xdr::xvector<float> vf;
+    xdr::xvector<double> vd;
+    for (size_t i = 0; i < n; i++) {
+      vi.push_back(int32_t(next()));
+      vu.push_back(next());
+      vf.push_back(float(int32_t(next())) / 7);
+      vd.push_back(double(int64_t(next())) / 13);
+    }
+    check_numeric_block(vi);
+    check_numeric_block(vu);
+    check_numeric_block(vf);
+    check_numeric_block(vd);
+  }
+
+  xdr::xarray<uint32_t, 37> au;
+  xdr::xarray<int64_t, 9> ai;
+  for (auto &v : au)
+    v = uint32_t(next());
+  for (auto &v : ai)
+    v = int64_t(next());
+  check_numeric_block(au);
+  check_numeric_block(ai);
+
+  // 64-bit values that are only 4-byte aligned in the buffer
+  {
+    xdr::xvector<double> vd { 1.5, -2.25, 1e300, 3.0, 4.0, 5.0 };
+    xdr::xvector<double> ud;
+    uint32_t x;
+    xdr::xdr_from_msg(xdr::xdr_to_msg(uint32_t(7), vd), x, ud);
+    assert(x == 7);
+    assert(ud == vd);
+  }
+
+  // Bounds are checked before anything is resized
+  {
+    xdr::xvector<int32_t> v { 1, 2, 3, 4, 5, 6 };
+    xdr::xvector<int32_t, 5> small;
+    bool ok = false;
+    try { xdr::xdr_from_msg(xdr::xdr_to_msg(v), small); }
+    catch (const xdr::xdr_overflow &) { ok = true; }
+    assert(ok);
+
+    xdr::msg_ptr m = xdr::xdr_to_msg(v);
+    m->shrink(m->size() - 4);
+    xdr::xvector<int32_t> u;
+    ok = false;
+    try { xdr::xdr_from_msg(m, u); }
+    catch (const xdr::xdr_overflow &) { ok = true; }
+    assert(ok);
+    assert(u.empty());
+  }
+}
+
+void
+test_fixed_size_check()
+{
+  testns::numerics n;
+  n.i1 = 0x12345678;
+  n.i3 = -99;
+  n.f2 = 2.5;
+  n.e1 = testns::REDDER;
+  constexpr size_t size = xdr::xdr_traits<testns::numerics>::fixed_size;
+  static_assert(size == 44);
+
+  alignas(8) uint32_t buf[size/4 + 1];
+  {
+    xdr::xdr_put p(buf, buf + size/4);
+    p(n);
+    assert(p.p_ == p.e_);
+    testns::numerics m;
+    xdr::xdr_get g(buf, buf + size/4);
+    g(m);
+    g.done();
+    assert(xdr::xdr_to_string(m) == xdr::xdr_to_string(n));
+  }
+
+  // The single check happens before anything is written or read
+  {
+    memset(buf, 0xa5, sizeof buf);
+    xdr::xdr_put p(buf, buf + size/4 - 1);
+    bool ok = false;
+    try { p(n); }
+    catch (const xdr::xdr_overflow &) { ok = true; }
+    assert(ok);
+    assert(p.p_ == buf);
+    assert(buf[0] == 0xa5a5a5a5);
+
+    testns::numerics m;
+    xdr::xdr_get g(buf, buf + size/4 - 1);
+    ok = false;
+    try { g(m); }
+    catch (const xdr::xdr_overflow &) { ok = true; }
+    assert(ok);
+    assert(g.p_ == buf);
+  }
+
+  // Enum validation still happens inside fixed-size structures
+  {
+    testns::numerics m;
+    xdr::msg_ptr msg = xdr::xdr_to_msg(n);
+    reinterpret_cast<uint32_t *>(msg->data())[size/4 - 1] = xdr::swap32le(99);
+    bool ok = false;
+    try { xdr::xdr_from_msg(msg, m); }
+    catch (const xdr::xdr_invariant_failed &) { ok = true; }
+    assert(ok);
+  }
+
+  // A fixed-size struct nested in variable-size data
+  {
+    v12 v(3);
+    v[1].i = 7;
+    v[2].d = 1.25;
+    v12 w;
+    xdr::xdr_from_msg(xdr::xdr_to_msg(v), w);
+    assert(v == w);
+  }
+}
+
+void
+test_views()
+{
+  using owned_t = tuple<uint32_t, xdr::opaque_vec<>, xdr::xstring<>>;
+  using view_t = tuple<uint32_t, xdr::opaque_view<>, xdr::xstring_view<>>;
+
+  owned_t o {7, {1, 2, 3, 4, 5}, "hello world"};
+  xdr::shared_msg_ptr m {xdr::xdr_to_msg(o)};
+  view_t v;
+  xdr::xdr_from_msg(m, v);
+  assert(get<0>(v) == 7);
+  assert(get<1>(v).vec() == get<1>(o));
+  assert(string_view(get<2>(v)) == "hello world");
+  assert(xdr::xdr_to_opaque(v) == xdr::xdr_to_opaque(o));
+  assert(xdr::xdr_to_string(v) == xdr::xdr_to_string(o));
+
+  // The views point into the message and share ownership of it
+  const char *p = reinterpret_cast<const char *>(get<1>(v).data());
+  assert(p > m->data() && p < m->end());
+  assert(get<2>(v).owner() == m);
+  xdr::xstring_view<> keep = get<2>(v);
+  m.reset();
+  v = view_t{};
+  assert(keep.str() == "hello world");
+
+  // Padding and bounds are still checked
+  {
+    xdr::msg_ptr bad = xdr::xdr_to_msg(xdr::xstring<>("abc"));
+    bad->data()[7] = 1;
+    xdr::xstring_view<> sv;
+    bool ok = false;
+    try { xdr::xdr_from_msg(bad, sv); }
+    catch (const xdr::xdr_should_be_zero &) { ok = true; }
+    assert(ok);
+
+    xdr::xstring_view<3> small;
+    ok = false;
+    try { xdr::xdr_from_msg(xdr::xdr_to_msg(xdr::xstring<>("abcd")), small); }
+    catch (const xdr::xdr_overflow &) { ok = true; }
+    assert(ok);
+  }
+}
+
+void
+test_iovec_put()
+{
+  testns::containertest1 ct;
+  ct.uvec.resize(2);
+  ct.uvec[0].which(4).f4().i = 11;
+  ct.uvec[1].which(12).f12().i = 12;
+  ct.sarr[0] = string(1000, 'x');
+  ct.sarr[1] = string(33, 'y');
+  testns::uniontest ut;
+  ut.key.arbitrary(::REDDEST).big().resize(4097);
+  memset(ut.key.big().data(), 0xa5, ut.key.big().size());
+  testns::numerics n {true, -1, 2, -3, 4, 5.0, 6.0, testns::REDDER};
+
+  xdr::msg_ptr expect = xdr::xdr_to_msg(ct, n, ut, ct);
+  for (size_t threshold : {0, 1, 33, 34, 512, 100000}) {
+    xdr::iovec_msg m;
+    xdr::xdr_iovec_put p(m, threshold);
+    xdr::xdr_argpack_archive(p, ct, n, ut, ct);
+    p.finish();
+    assert(m.size() == expect->size());
+    xdr::msg_ptr flat = m.flatten();
+    assert(!memcmp(flat->raw_data(), expect->raw_data(), expect->raw_size()));
+    if (threshold == 512) {
+      // Both 1000-byte strings and the union body are referenced in place
+      assert(m.iovcnt() == 8);
+      assert(m.iov()[1].iov_base == ct.sarr[0].data());
+    }
+    else if (threshold == 100000)
+      assert(m.iovcnt() == 1);
+  }
+}
+
+void
+test_grow_put()
+{
+  test_recursive tr;
+  tr.elem = "root";
+  for (int i = 0; i < 50; i++) {
+    test_recursive &c = tr.nextvec.emplace_back();
+    c.elem = string(i, 'c');
+    c.nextvec.resize(i % 3);
+  }
+  tr.next.activate().elem = "next";
+  testns::numerics n {true, -1, 2, -3, 4, 5.0, 6.0, testns::REDDER};
+
+  xdr::msg_ptr expect = xdr::xdr_to_msg(tr, n, tr);
+  xdr::msg_ptr m = xdr::xdr_to_msg_grow(tr, n, tr);
+  assert(m->size() == expect->size());
+  assert(!memcmp(m->raw_data(), expect->raw_data(), expect->raw_size()));
+
+  // Start from an empty buffer so nearly every field forces a resize
+  xdr::xdr_grow_put p(0);
+  xdr::xdr_argpack_archive(p, tr, n, tr);
+  m = p.finish();
+  assert(!memcmp(m->raw_data(), expect->raw_data(), expect->raw_size()));
+
+  assert(xdr::xdr_to_msg_grow()->size() == 0);
+}
+
+void
+test_message_pool()
+{
+  using xdr::message_t;
+  message_t::enable_pool();
+  xdr::message_pool_stats s0 = message_t::pool_stats();
+
+  // Same size class, so the second allocation reuses the first buffer
+  const char *first;
+  {
+    xdr::msg_ptr m = message_t::alloc(100);
+    first = m->data();
+  }
+  xdr::msg_ptr m = message_t::alloc(90);
+  assert(m->data() == first);
+  xdr::message_pool_stats s1 = message_t::pool_stats();
+  assert(s1.hits >= s0.hits + 1);
+  assert(s1.recycled >= s0.recycled + 1);
+
+  // Growing within and beyond the size class preserves the contents
+  memset(m->data(), 7, m->size());
+  xdr::message_t::resize(m, 92);
+  assert(m->data() == first && m->size() == 92);
+  xdr::message_t::resize(m, 5000);
+  assert(m->size() == 5000 && m->data()[89] == 7);
+  assert(xdr::xdr_to_msg_grow(xdr::xstring<>(string(3000, 'p')))->size() == 3004);
+
+  // Oversized buffers bypass the pool
+  xdr::msg_ptr big = message_t::alloc(0x20000);
+  big.reset();
+  m.reset();
+  message_t::enable_pool(false);
+  xdr::message_pool_stats s2 = message_t::pool_stats();
+  assert(s2.misses >= s1.misses + 1);
+
+  // Small messages are cached even with the pool off
+  const char *small;
+  {
+    xdr::msg_ptr e = xdr::rpc_accepted_error_msg(7, xdr::PROG_UNAVAIL);
+    small = e->data();
+  }
+  xdr::msg_ptr c = xdr::xdr_to_msg(uint32_t(1), xdr::xstring<>("hello"));
+  assert(c->data() == small);
+  assert(message_t::pool_stats().hits >= s2.hits + 1);
+  c.reset();
+  xdr::msg_ptr large = message_t::alloc(message_t::small_size + 1);
+  assert(large->data() != small);
+}
+
+test_recursive
+make_recursive(int depth, int fanout, size_t len)
+{
+  test_recursive t;
+  t.elem = string(len, 'r');
+  if (depth > 0) {
+    for (int i = 0; i < fanout; i++)
+      t.nextvec.push_back(make_recursive(depth - 1, fanout + i, len + i));
+    if (fanout & 1)
+      t.next.activate() = make_recursive(depth - 1, 1, len * 2);
+  }
+  return t;
+}
+
+string
+hexdigest(const xdr::sha256::result_type &d)
+{
+  string out;
+  for (uint8_t c : d) {
+    out += "0123456789abcdef"[c >> 4];
+    out += "0123456789abcdef"[c & 0xf];
+  }
+  return out;
+}
+
+template<typename...Args> void
+check_digest(const Args &...args)
+{
+  xdr::opaque_vec<> o = xdr::xdr_to_opaque(args...);
+  xdr::sha256 s;
+  s.update(o.data(), o.size());
+  assert(xdr::xdr_digest<xdr::sha256>(args...) == s.digest());
+  xdr::xxhash64 x;
+  x.update(o.data(), o.size());
+  assert(xdr::xdr_digest<xdr::xxhash64>(args...) == x.digest());
+}
+
+void
+test_digest()
+{
+  xdr::sha256 s;
+  assert(hexdigest(s.digest()) == "e3b0c44298fc1c149afbf4c8996fb924"
+	 "27ae41e4649b934ca495991b7852b855");
+  s.update("abc", 3);
+  assert(hexdigest(s.digest()) == "ba7816bf8f01cfea414140de5dae2223"
+	 "b00361a396177a9cb410ff61f20015ad");
+  const string two_blocks =
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  s.update(two_blocks.data(), two_blocks.size());
+  assert(hexdigest(s.digest()) == "248d6a61d20638b8e5c026930c3e6039"
+	 "a33ce45964ff2167f6ecedd419db06c1");
+
+  xdr::xxhash64 x;
+  assert(x.digest() == 0xef46db3751d8e999ULL);
+  x.update("abc", 3);
+  assert(x.digest() == 0x44bc2cf5ad770999ULL);
+
+  // Feeding bytes in pieces must not change the result
+  string text;
+  for (int i = 0; i < 300; i++)
+    text += char('a' + i % 26);
+  for (size_t step : {1, 3, 31, 32, 33, 64, 65}) {
+    xdr::sha256 s1, s2;
+    xdr::xxhash64 x1, x2;
+    s1.update(text.data(), text.size());
+    x1.update(text.data(), text.size());
+    for (size_t i = 0; i < text.size(); i += step) {
+      s2.update(text.data() + i, min(step, text.size() - i));
+      x2.update(text.data() + i, min(step, text.size() - i));
+    }
+    assert(s1.digest() == s2.digest());
+    assert(x1.digest() == x2.digest());
+  }
+
+  testns::numerics n {true, -1, 2, -3, 4, 5.0, 6.0, testns::REDDER};
+  check_digest(n);
+  check_digest(make_recursive(3, 2, 5));
+  testns::containertest1 ct;
+  ct.uvec.resize(2);
+  ct.uvec[0].which(4).f4().i = 11;
+  ct.uvec[1].which(12).f12().i = 12;
+  ct.sarr[0] = string(1000, 'x');
+  ct.sarr[1] = string(33, 'y');
+  check_digest(ct, n, ct);
+  xdr::xvector<double> dv(1001, 1.5);
+  xdr::xvector<uint32_t> uv(777, 7);
+  v12 fv(100);
+  check_digest(dv, uv, fv);
+  check_digest();
+}
+
+// Feed a record to d in chunks of at most chunk bytes, starting skew
+// bytes into an aligned buffer.
+template<typename T> void
+stream_feed(xdr::xdr_stream_decoder<T> &d, const xdr::msg_ptr &m,
+	    size_t chunk, size_t skew)
+{
+  vector<uint32_t> buf(m->size() / 4 + 2);
+  char *p = reinterpret_cast<char *>(buf.data()) + skew;
+  memcpy(p, m->data(), m->size());
+  for (size_t pos = 0;;) {
+    size_t n = min(chunk, m->size() - pos);
+    bool eor = pos + n == m->size();
+    assert(d.feed(p + pos, n, eor) == eor);
+    pos += n;
+    if (eor)
+      break;
+  }
+}
+
+template<typename T> void
+check_stream_get(const T &t)
+{
+  xdr::msg_ptr m = xdr::xdr_to_msg(t);
+  for (size_t chunk : {1, 3, 4, 7, 64, 1 << 20})
+    for (size_t skew : {0, 1, 2}) {
+      T u;
+      xdr::xdr_stream_decoder<T> d(u);
+      stream_feed(d, m, chunk, skew);
+      assert(xdr::xdr_to_string(u) == xdr::xdr_to_string(t));
+      // Decode again into the same object
+      stream_feed(d, m, chunk + 1, 0);
+      assert(xdr::xdr_to_string(u) == xdr::xdr_to_string(t));
+    }
+}
+
+void
+test_stream_get()
+{
+  check_stream_get(make_recursive(3, 3, 5));
+
+  xdr::xvector<double> vd;
+  xdr::xvector<uint32_t> vu;
+  for (int i = 0; i < 1000; i++) {
+    vd.push_back(i / 7.0);
+    vu.push_back(i * 0x10001);
+  }
+  check_stream_get(vd);
+  check_stream_get(vu);
+
+  testns::containertest ct;
+  for (int i = 0; i < 20; i++) {
+    if (i & 1)
+      ct.uvec.emplace_back().which(4).f4().i = i;
+    else
+      ct.uvec.emplace_back().which(12).f12().i = i;
+  }
+  ct.sarr[0] = "first";
+  ct.sarr[1] = "second string";
+  check_stream_get(ct);
+
+  testns::hasbytes hb;
+  for (int i = 0; i < 17; i++) {
+    testns::bytes &b = hb.the_bytes.emplace_back();
+    b.s = string(i, 's');
+    b.fixed.fill(i);
+    for (int j = 0; j < i; j++)
+      b.variable.push_back(j);
+  }
+  check_stream_get(hb);
+
+  xdr::msg_ptr good = xdr::xdr_to_msg(vu);
+  xdr::xvector<uint32_t> u;
+  xdr::xdr_stream_decoder<xdr::xvector<uint32_t>> d(u);
+
+  // Record ends early
+  bool ok = false;
+  try { d.feed(good->data(), good->size() - 4, true); }
+  catch (const xdr::xdr_overflow &) { ok = true; }
+  assert(ok);
+
+  // Record has extra bytes; the remainder is skipped
+  xdr::msg_ptr extra = xdr::xdr_to_msg(vu, uint32_t(0));
+  ok = false;
+  try { d.feed(extra->data(), extra->size() - 2, false); }
+  catch (const xdr::xdr_bad_message_size &) { ok = true; }
+  assert(ok);
+  assert(!d.feed(extra->data(), 2, true));
+  stream_feed(d, good, 100, 0);
+  assert(u == vu);
+
+  // A bogus length does not allocate space ahead of the data
+  {
+    xdr::xvector<uint32_t> big;
+    xdr::xdr_stream_decoder<xdr::xvector<uint32_t>> bd(big);
+    xdr::msg_ptr hdr = xdr::xdr_to_msg(uint32_t(0x10000000), vu);
+    assert(!bd.feed(hdr->data(), hdr->size(), false));
+    assert(big.size() == vu.size() + 1);
+    assert(big.capacity() < 0x10000);
+    // bd is destroyed mid-record
+  }
+}
+
 // Test recursive structure for depth checking
 struct TestNode
 {
@@ -458,7 +1023,16 @@ int
 main()
 {
   test_size();
+  test_max_size();
   test_tuple();
+  test_numeric_blocks();
+  test_fixed_size_check();
+  test_views();
+  test_iovec_put();
+  test_grow_put();
+  test_digest();
+  test_message_pool();
+  test_stream_get();
   test_depth_checker();
 
   testns::bytes b1, b2;
@@ -5,16 +5,19 @@
 #include <sstream>
 #include <thread>
 #include <sys/socket.h>
+#include <xdrpp/marshal.h>
 #include <xdrpp/msgsock.h>
 #include <xdrpp/printer.h>
+#include <xdrpp/srpc.h>
+#include <xdrpp/stream_get.h>
 
 using namespace std;
 using namespace xdr;
 
 void
-echoserver(sock_t s)
+echoserver(sock_t s, pollset::backend b)
 {
-  pollset_plus ps;
+  pollset_plus ps(b);
   bool done {false};
   msg_sock ss(ps, s, nullptr);
   int i = 0;
@@ -34,9 +37,9 @@ echoserver(sock_t s)
 }
 
 void
-echoclient(sock_t s)
+echoclient(sock_t s, pollset::backend b)
 {
-  pollset_plus ps;
+  pollset_plus ps(b);
   msg_sock ss { ps, s };
   unsigned int i = 0;
 
@@ -61,8 +64,126 @@ echoclient(sock_t s)
     ps.poll();
 }
 
-int
-main(int argc, char **argv)
+// Interleave scatter-gather and contiguous messages, with bodies
+// large enough that writev must stop partway through a chain.
+void
+iovec_test(pollset::backend b)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    exit(1);
+  }
+
+  pollset ps(b);
+  msg_sock ws { ps, sock_t(fds[0]) };
+  vector<msg_ptr> expected;
+  size_t received = 0;
+  msg_sock rs(ps, sock_t(fds[1]), [&](msg_ptr b) {
+      assert(b);
+      assert(received < expected.size());
+      const msg_ptr &e = expected[received++];
+      assert(b->size() == e->size());
+      assert(!memcmp(b->data(), e->data(), b->size()));
+    }, 0x1000000);
+
+  auto body = make_shared<opaque_vec<>>();
+  xstring<> small("small");
+  for (uint32_t i = 0; i < 8; i++) {
+    body->resize(0x40000 + 1001 * i);
+    memset(body->data(), 'a' + i, body->size());
+    expected.push_back(xdr_to_msg(i, *body, small, *body));
+    if (i & 1)
+      ws.putmsg(xdr_to_msg(i, *body, small, *body));
+    else {
+      iovec_msg m = xdr_to_iovec_msg(i, *body, small, *body);
+      assert(m.iovcnt() > 2);
+      m.hold(body);
+      body = make_shared<opaque_vec<>>();
+      ws.putmsg(std::move(m));
+    }
+  }
+
+  while (received < expected.size() && ps.pending())
+    ps.poll();
+  assert(received == expected.size());
+}
+
+// Send records as many small fragments, and receive them both
+// reassembled and a fragment at a time.
+void
+fragment_test(pollset::backend b)
+{
+  int fds[2][2];
+  for (auto &f : fds)
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, f) == -1) {
+      perror("socketpair");
+      exit(1);
+    }
+
+  pollset ps(b);
+  msg_sock ws1 { ps, sock_t(fds[0][0]) }, ws2 { ps, sock_t(fds[1][0]) };
+  ws1.set_fragsize(100);
+  ws2.set_fragsize(64);
+
+  vector<msg_ptr> expected;
+  size_t received = 0;
+  msg_sock rs(ps, sock_t(fds[0][1]), [&](msg_ptr b) {
+      assert(b);
+      assert(received < expected.size());
+      const msg_ptr &e = expected[received++];
+      assert(b->size() == e->size());
+      assert(!memcmp(b->data(), e->data(), b->size()));
+    }, 4096);
+
+  string frags;
+  size_t nfrags = 0, records = 0;
+  msg_sock fs(ps, sock_t(fds[1][1]));
+  fs.setfcb([&](msg_ptr b, bool last) {
+      assert(b);
+      assert(b->size() <= 64);
+      frags.append(b->data(), b->size());
+      ++nfrags;
+      if (last) {
+	const msg_ptr &e = expected[records++];
+	assert(frags.size() == e->size());
+	assert(!memcmp(frags.data(), e->data(), frags.size()));
+	frags.clear();
+      }
+    });
+
+  auto body = make_shared<opaque_vec<>>();
+  for (uint32_t i = 0; i < 6; i++) {
+    body->resize(100 * i + 3);
+    memset(body->data(), 'a' + i, body->size());
+    expected.push_back(xdr_to_msg(i, *body));
+    if (i & 1) {
+      ws1.putmsg(xdr_to_msg(i, *body));
+      ws2.putmsg(xdr_to_msg(i, *body));
+    }
+    else {
+      iovec_msg m = xdr_to_iovec_msg(i, *body);
+      assert(m.fragments() == 1);
+      iovec_msg f = iovec_msg::fragmented(xdr_to_iovec_msg(i, *body), 100);
+      f.hold(body);
+      ws1.putmsg(std::move(f));
+      m.hold(body);
+      body = make_shared<opaque_vec<>>();
+      ws2.putmsg(std::move(m));
+    }
+  }
+
+  while ((received < expected.size() || records < expected.size())
+	 && ps.pending())
+    ps.poll();
+  assert(received == expected.size());
+  assert(records == expected.size());
+  assert(nfrags > 2 * expected.size());
+}
+
+// Decode records incrementally as they are read from the socket.
+void
+stream_test(pollset::backend b)
 {
   int fds[2];
   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
@@ -70,9 +191,148 @@ main(int argc, char **argv)
     exit(1);
   }
 
-  thread t1 (echoclient, sock_t(fds[0]));
-  echoserver(sock_t(fds[1]));
-  t1.join();
+  using strvec = xvector<xstring<>>;
+  pollset ps(b);
+  msg_sock ws { ps, sock_t(fds[0]) };
+  // Fragments that are not a multiple of 4 leave values unaligned
+  ws.set_fragsize(333);
+
+  vector<strvec> expected;
+  size_t received = 0;
+  bool eof = false;
+  strvec val;
+  xdr_stream_decoder<strvec> dec(val);
+  msg_sock rs(ps, sock_t(fds[1]));
+  rs.setscb([&](const char *p, size_t n, bool eor) {
+      if (!p) {
+	eof = true;
+	return;
+      }
+      if (dec.feed(p, n, eor)) {
+	assert(received < expected.size());
+	assert(val == expected[received++]);
+      }
+    });
+
+  for (int i = 0; i < 5; i++) {
+    strvec &v = expected.emplace_back();
+    for (int j = 0; j < 100 * i; j++)
+      v.push_back(string(j % 23, 'a' + i));
+    ws.putmsg(xdr_to_msg(v));
+  }
+
+  while (received < expected.size() && ps.pending())
+    ps.poll();
+  assert(received == expected.size());
+  assert(!eof);
+}
+
+// Send one shared message to several sockets.
+void
+fanout_test(pollset::backend b)
+{
+  constexpr int nsocks = 4;
+  pollset ps(b);
+  vector<unique_ptr<msg_sock>> ws, rs;
+  size_t received = 0;
+
+  opaque_vec<> body(opaque_vec<>::size_type{50000});
+  memset(body.data(), 'f', body.size());
+  shared_msg_ptr m {xdr_to_msg(body)};
+
+  for (int i = 0; i < nsocks; i++) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+      perror("socketpair");
+      exit(1);
+    }
+    ws.push_back(make_unique<msg_sock>(ps, sock_t(fds[0])));
+    if (i & 1)
+      ws.back()->set_fragsize(1000 * i);
+    rs.push_back(make_unique<msg_sock>(ps, sock_t(fds[1]), [&](msg_ptr b) {
+	  assert(b);
+	  assert(b->size() == m->size());
+	  assert(!memcmp(b->data(), m->data(), b->size()));
+	  ++received;
+	}));
+    ws.back()->putmsg(m);
+  }
+
+  while (received < nsocks && ps.pending())
+    ps.poll();
+  assert(received == nsocks);
+  for (auto &s : ws)
+    assert(s->wsize() == 0);
+  assert(m.use_count() == 1);
+}
+
+// The synchronous read_message limits the whole record, not just
+// each fragment.
+void
+read_message_test()
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    exit(1);
+  }
+  auto frag = [&](uint32_t len, bool last) {
+    uint32_t mark = swap32le(len | (last ? 0x80000000 : 0));
+    string buf(reinterpret_cast<char *>(&mark), 4);
+    buf.append(len, 'x');
+    assert(write(fds[0], buf.data(), buf.size()) == ssize_t(buf.size()));
+  };
+
+  frag(12, false);
+  frag(12, true);
+  msg_ptr m = read_message(fds[1], 24);
+  assert(m->size() == 24);
+
+  frag(12, false);
+  frag(12, false);
+  bool threw = false;
+  try { read_message(fds[1], 16); }
+  catch (const xdr_bad_message_size &) { threw = true; }
+  assert(threw);
+
+  // A single fragment larger than the default cap still round-trips
+  opaque_vec<> big(3 * msg_sock::default_maxmsglen / 2);
+  for (size_t i = 0; i < big.size(); i++)
+    big[i] = uint8_t(i * 7);
+  thread t([&]() { write_message(fds[0], xdr_to_msg(big)); });
+  m = read_message(fds[1]);
+  t.join();
+  opaque_vec<> got;
+  xdr_from_msg(m, got);
+  assert(got == big);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int
+main(int argc, char **argv)
+{
+  using backend = pollset::backend;
+  for (backend b : { backend::Poll, backend::Epoll, backend::Uring }) {
+    iovec_test(b);
+    fragment_test(b);
+    stream_test(b);
+    fanout_test(b);
+  }
+
+  // Exercise the buffer pool with messages freed on both threads
+  message_t::enable_pool();
+  for (backend b : { backend::Poll, backend::Epoll, backend::Uring }) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+      perror("socketpair");
+      exit(1);
+    }
+    thread t1 (echoclient, sock_t(fds[0]), b);
+    echoserver(sock_t(fds[1]), b);
+    t1.join();
+  }
 
   return 0;
 }
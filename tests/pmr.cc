@@ -0,0 +1,107 @@
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <xdrpp/marshal.h>
+#include <xdrpp/printer.h>
+#include "tests/pmrtest.hh"
+
+using namespace std;
+using namespace pmrtest;
+
+// Count global heap allocations
+static size_t alloc_count;
+void *
+operator new(size_t n)
+{
+  ++alloc_count;
+  if (void *p = malloc(n ? n : 1))
+    return p;
+  throw bad_alloc();
+}
+void *
+operator new(size_t n, align_val_t a)
+{
+  ++alloc_count;
+  if (void *p = aligned_alloc(size_t(a), (max(n, size_t(1)) + size_t(a) - 1)
+			      & ~(size_t(a) - 1)))
+    return p;
+  throw bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { free(p); }
+
+request
+make_request(size_t n)
+{
+  request r;
+  r.tag = "pmr";
+  for (size_t i = 0; i < n; i++) {
+    item &it = r.items.emplace_back();
+    it.name = "item " + to_string(i);
+    it.data.resize(i % 37);
+    for (size_t j = 0; j < i % 5; j++)
+      it.values.push_back(int32_t(i + j));
+    if (i % 3 == 0)
+      it.child.activate().name = "child";
+  }
+  r.first.activate() = r.items.at(0);
+  return r;
+}
+
+int
+main()
+{
+  request orig = make_request(10000);
+  xdr::msg_ptr m = xdr::xdr_to_msg(orig);
+
+  // Default resource is the heap
+  {
+    request r;
+    size_t start = alloc_count;
+    xdr::xdr_from_msg(m, r);
+    assert(alloc_count - start > 10000);
+    assert(r == orig);
+  }
+
+  // Decode everything into an arena, touching the heap only for
+  // the arena's own buffers
+  std::pmr::monotonic_buffer_resource arena(1 << 20);
+  {
+    xdr::pmr::resource_scope scope(&arena);
+    size_t start = alloc_count;
+    auto *r = new (arena.allocate(sizeof(request), alignof(request))) request;
+    xdr::xdr_from_msg(m, *r);
+    assert(alloc_count - start < 64);
+    assert(*r == orig);
+    assert(r->items.get_allocator().resource() == &arena);
+    assert(r->items[0].name.get_allocator().resource() == &arena);
+    assert(r->items[3].child.resource() == &arena);
+    assert(r->first->name.get_allocator().resource() == &arena);
+    assert(xdr::xdr_to_string(r->first->child)
+	   == xdr::xdr_to_string(orig.first->child));
+  }
+  assert(xdr::pmr::current_resource() == std::pmr::new_delete_resource());
+  // Skip the destructor; everything is in the arena
+  arena.release();
+
+  // Copies and moves between resources
+  {
+    std::pmr::monotonic_buffer_resource other;
+    xdr::pmr::pointer<item> p;
+    {
+      xdr::pmr::resource_scope scope(&other);
+      xdr::pmr::pointer<item> q;
+      q.activate().name = "q";
+      assert(q.resource() == &other);
+      p = std::move(q);
+    }
+    assert(p && p->name == "q" && p.resource() != &other);
+  }
+
+  return 0;
+}
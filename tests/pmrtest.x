@@ -0,0 +1,20 @@
+/* Compiled with xdrc -pmr for tests/pmr.cc */
+
+namespace pmrtest {
+%using xdr::operator==;
+%using xdr::operator<=>;
+
+struct item {
+  string name<>;
+  opaque data<>;
+  int values<>;
+  item *child;
+};
+
+struct request {
+  string tag<32>;
+  item items<>;
+  item *first;
+};
+
+}
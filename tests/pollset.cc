@@ -0,0 +1,412 @@
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <xdrpp/pollset.h>
+
+using namespace std;
+using namespace xdr;
+
+using backend = pollset::backend;
+
+void
+make_pair(int fds[2])
+{
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    perror("socketpair");
+    exit(1);
+  }
+}
+
+void
+test_fd_cbs(backend b)
+{
+  pollset ps(b);
+  assert(!ps.pending());
+  int fds[2];
+  make_pair(fds);
+
+  int reads = 0, writes = 0;
+  ps.fd_cb(fds[0], pollset::Read, [&]() {
+      char c;
+      assert(read(fds[0], &c, 1) == 1);
+      ++reads;
+    });
+  ps.fd_cb(fds[1], pollset::WriteOnce, [&]() { ++writes; });
+  assert(ps.pending());
+
+  ps.poll(0);
+  assert(reads == 0 && writes == 1);
+  ps.poll(0);
+  assert(writes == 1);
+
+  assert(write(fds[1], "ab", 2) == 2);
+  ps.poll(0);
+  ps.poll(0);
+  assert(reads == 2);
+  ps.poll(0);
+  assert(reads == 2);
+
+  // Removing a callback from within another one, and replacing it
+  ps.fd_cb(fds[1], pollset::Write, [&]() {
+      ++writes;
+      ps.fd_cb(fds[0], pollset::Read);
+      ps.fd_cb(fds[1], pollset::Write);
+    });
+  assert(write(fds[1], "c", 1) == 1);
+  ps.poll(0);
+  assert(writes == 2);
+  ps.poll(0);
+  assert(reads <= 3 && writes == 2);
+  assert(!ps.pending());
+
+  // A descriptor closed and reused before being registered again
+  ps.fd_cb(fds[0], pollset::Read, [&]() { ++reads; });
+  ps.fd_cb(fds[0], pollset::Read);
+  ps.poll(0);			// Poll backend needs this before close
+  close(fds[0]);
+  close(fds[1]);
+  make_pair(fds);
+  ps.fd_cb(fds[0], pollset::ReadOnce, [&]() { reads = 100; });
+  assert(write(fds[1], "d", 1) == 1);
+  ps.poll(0);
+  assert(reads == 100);
+  assert(!ps.pending());
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Only ready descriptors' callbacks run, however many are idle.
+void
+test_regular_file(backend b)
+{
+  // epoll rejects regular files, which poll reports always ready
+  char path[] = "/tmp/xdrpp-pollsetXXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  unlink(path);
+  int fds[2];
+  make_pair(fds);
+
+  pollset ps(b);
+  int reads = 0, writes = 0, sockreads = 0;
+  ps.fd_cb(fds[0], pollset::Read, [&]() { ++sockreads; });
+  ps.fd_cb(fd, pollset::Read, [&]() { ++reads; });
+  ps.fd_cb(fd, pollset::WriteOnce, [&]() { ++writes; });
+  // Must not block on the idle socket
+  ps.poll();
+  assert(reads == 1 && writes == 1 && sockreads == 0);
+  ps.poll();
+  assert(reads == 2 && writes == 1);
+
+  ps.fd_cb(fd, pollset::Read);
+  ps.fd_cb(fds[0], pollset::Read);
+  ps.poll(0);
+  assert(reads == 2 && !ps.pending());
+
+  // The descriptor can be registered again once idle
+  ps.fd_cb(fd, pollset::ReadOnce, [&]() { ++reads; });
+  ps.poll();
+  assert(reads == 3 && !ps.pending());
+
+  close(fd);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void
+test_many(backend b)
+{
+  constexpr int npairs = 500;
+  pollset ps(b);
+  vector<int> fds(2 * npairs);
+  vector<int> hits(npairs);
+  for (int i = 0; i < npairs; i++) {
+    make_pair(&fds[2*i]);
+    ps.fd_cb(fds[2*i], pollset::Read, [&fds, &hits, i]() {
+	char c;
+	assert(read(fds[2*i], &c, 1) == 1);
+	++hits[i];
+      });
+  }
+
+  for (int i = 0; i < npairs; i += 7)
+    assert(write(fds[2*i+1], "x", 1) == 1);
+  ps.poll(0);
+  for (int i = 0; i < npairs; i++)
+    assert(hits[i] == (i % 7 ? 0 : 1));
+
+  for (int i = 0; i < npairs; i++)
+    ps.fd_cb(fds[2*i], pollset::Read);
+  ps.poll(0);
+  assert(!ps.pending());
+  for (int fd : fds)
+    close(fd);
+}
+
+void
+test_plus(backend b)
+{
+  pollset_plus ps(b);
+  assert(ps.get_backend() == b || b != backend::Poll);
+  bool injected = false, timed_out = false;
+  ps.timeout(1, [&]() { timed_out = true; });
+  thread t([&]() { ps.inject_cb([&]() { injected = true; }); });
+  while (!(injected && timed_out))
+    ps.poll();
+  t.join();
+}
+
+// Compare the wheel with a multimap under random additions,
+// cancellations, and reschedulings, advancing time by steps ranging
+// from a millisecond to hours.
+void
+test_timer_wheel()
+{
+  using detail::timer_wheel;
+  mt19937_64 rng(1);
+  int64_t now = 1000;
+  timer_wheel w(now);
+  multimap<int64_t, int> expect;	// when -> id
+  vector<timer_wheel::node *> nodes;
+  vector<int64_t> fired;		// id -> when, or -1 if pending
+  vector<bool> overdue;		// Scheduled in the past, so unordered
+  int64_t last_when = 0;
+
+  auto add = [&](int64_t when) {
+    int id = nodes.size();
+    fired.push_back(-1);
+    overdue.push_back(when <= now);
+    nodes.push_back(w.add(when, [&, id]() {
+	  assert(fired[id] == -1);
+	  fired[id] = now;
+	  auto i = expect.begin();
+	  while (i->second != id)
+	    ++i;
+	  assert(i->first <= now);
+	  if (!overdue[id]) {
+	    assert(i->first >= last_when);
+	    last_when = i->first;
+	  }
+	  expect.erase(i);
+	}));
+    expect.emplace(when, id);
+  };
+  auto pending = [&](int id) { return fired[id] == -1 && nodes[id]; };
+  auto erase = [&](int id) {
+    for (auto i = expect.begin();; ++i)
+      if (i->second == id) {
+	expect.erase(i);
+	return;
+      }
+  };
+
+  for (int round = 0; round < 2000; round++) {
+    int64_t range = int64_t(1) << (rng() % 40);
+    for (int i = rng() % 20; i-- > 0;)
+      add(now + int64_t(rng() % range) - 5);
+    if (round % 100 == 0)
+      add(now + (int64_t(1) << 61));
+    for (int i = rng() % 8; i-- > 0 && !nodes.empty();) {
+      int id = rng() % nodes.size();
+      if (!pending(id))
+	continue;
+      if (rng() & 1) {
+	w.cancel(nodes[id]);
+	nodes[id] = nullptr;
+	erase(id);
+      }
+      else {
+	int64_t when = now + int64_t(rng() % range) - 5;
+	w.reschedule(nodes[id], when);
+	overdue[id] = when <= now;
+	erase(id);
+	expect.emplace(when, id);
+      }
+    }
+    assert(w.size() == expect.size());
+    assert(expect.empty() || w.next_time() <= expect.begin()->first);
+
+    int64_t step = rng() % 4 ? rng() % 100 : rng() % (int64_t(1) << 26);
+    if (w.next_time() > now + step) {
+      size_t n = expect.size();
+      w.expire(now + step);
+      assert(expect.size() == n);
+    }
+    now += step;
+    last_when = numeric_limits<int64_t>::min();
+    w.expire(now);
+    assert(expect.empty() || expect.begin()->first > now);
+  }
+}
+
+// Callbacks cancelling and rescheduling timeouts, including their
+// own, and throwing exceptions.
+void
+test_timer_callbacks()
+{
+  using detail::timer_wheel;
+  timer_wheel w(0);
+  int a = 0, b = 0, c = 0;
+  timer_wheel::node *na = nullptr, *nb = nullptr, *nc = nullptr;
+  na = w.add(10, [&]() {
+      if (++a < 3)
+	w.reschedule(na, 10 * (a + 1));
+      if (nb)
+	w.cancel(nb);
+      nb = nullptr;
+    });
+  nb = w.add(10, [&]() { ++b; });
+  nc = w.add(20, [&]() {
+      ++c;
+      w.cancel(nc);
+      throw 1;
+    });
+  w.add(20, [&]() { c += 10; });
+  (void) nc;
+
+  w.expire(10);
+  assert(a == 1 && b == 0 && w.size() == 3);
+  bool threw = false;
+  try {
+    w.expire(20);
+  }
+  catch (int) {
+    threw = true;
+  }
+  assert(threw);
+  w.expire(20);
+  assert(a == 2 && c == 11 && w.size() == 1);
+  assert(w.next_time() == 30);
+  w.expire(1000);
+  assert(a == 3 && w.size() == 0);
+  assert(w.next_time() == numeric_limits<int64_t>::max());
+
+  // Overdue timeouts run on the next call, even if added by callbacks.
+  int d = 0;
+  w.add(5, [&]() { if (++d == 1) w.add(0, [&]() { d += 10; }); });
+  assert(w.next_time() == numeric_limits<int64_t>::min());
+  w.expire(0);
+  assert(d == 1);
+  w.expire(0);
+  assert(d == 11 && w.size() == 0);
+}
+
+void
+test_timeouts()
+{
+  pollset ps;
+  vector<int> order;
+  int64_t now = pollset::now_ms();
+  auto t1 = ps.timeout_at(now + 20, [&]() { order.push_back(1); });
+  auto t2 = ps.timeout_at(now + 10, [&]() { order.push_back(2); });
+  auto t3 = ps.timeout_at(now + 10, [&]() { order.push_back(3); });
+  auto t4 = ps.timeout_at(now, [&]() { order.push_back(4); });
+  auto t5 = ps.timeout(60000, [&]() { order.push_back(5); });
+  assert(t1 && t2 && !pollset::timeout_null() && !pollset::Timeout());
+  ps.timeout_cancel(t3);
+  assert(!t3);
+  ps.timeout_reschedule_at(t4, now + 30);
+  auto t5copy = t5;
+  ps.timeout_reschedule_at(t5, now + 40);
+  assert(ps.timeout_time(t5copy) == now + 40);
+  while (order.size() < 4)
+    ps.poll();
+  assert((order == vector{2, 1, 4, 5}));
+  assert(!ps.pending());
+}
+
+void
+test_thread_pool()
+{
+  // Subtasks queued by a busy worker get stolen by the idle one
+  thread_pool pool(2);
+  atomic<int> subtasks {0};
+  atomic<bool> stole {false};
+  pool.submit([&]() {
+      for (int i = 0; i < 10; i++)
+	pool.submit([&]() { ++subtasks; });
+      auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+      while (subtasks < 10 && chrono::steady_clock::now() < deadline)
+	this_thread::yield();
+      stole = subtasks == 10;
+    });
+  while (pool.stats().completed < 11)
+    this_thread::yield();
+  assert(stole);
+  auto st = pool.stats();
+  assert(st.threads == 2 && st.stolen >= 10 && st.queued == 0);
+  assert(st.max_queued >= 1 && pool.depth(0) == 0 && pool.depth(1) == 0);
+
+  // Destruction runs everything already submitted
+  int n = 0;
+  {
+    thread_pool p1(1);
+    for (int i = 0; i < 100; i++)
+      p1.submit([&n]() { ++n; });
+  }
+  assert(n == 100);
+}
+
+void
+test_async()
+{
+  constexpr int nthreads = 3, ntasks = 200;
+  pollset_plus ps;
+  assert(&ps.pool() == thread_pool::shared().get());
+  assert(ps.pool().size() >= thread_pool::shared_min_threads);
+  auto pool = make_shared<thread_pool>(nthreads);
+  ps.set_pool(pool);
+  assert(&ps.pool() == pool.get());
+
+  atomic<int> inside {0}, max_inside {0};
+  int done = 0, sum = 0;
+  for (int i = 0; i < ntasks; i++)
+    ps.async([i, &inside, &max_inside]() {
+	int n = ++inside;
+	for (int m = max_inside; n > m && !max_inside.compare_exchange_weak(m, n);)
+	  ;
+	this_thread::sleep_for(chrono::microseconds(100));
+	--inside;
+	return i;
+      }, [&](int r) {
+	++done;
+	sum += r;
+      });
+  ps.async([]() { return make_unique<int>(7); },
+	   [&](unique_ptr<int> p) { done += *p; });
+  while (done < ntasks + 7)
+    ps.poll();
+  assert(sum == ntasks * (ntasks - 1) / 2);
+  assert(max_inside <= nthreads);
+  // A task counts as completed only after its callback is injected
+  while (pool->stats().completed < ntasks + 1)
+    this_thread::yield();
+  assert(pool->stats().queued == 0);
+}
+
+int
+main()
+{
+  test_thread_pool();
+  test_async();
+  test_timer_wheel();
+  test_timer_callbacks();
+  test_timeouts();
+  for (backend b : { backend::Poll, backend::Epoll, backend::Uring }) {
+    test_fd_cbs(b);
+    test_regular_file(b);
+    test_many(b);
+    test_plus(b);
+  }
+  assert(pollset().get_backend() == pollset::default_backend);
+  return 0;
+}
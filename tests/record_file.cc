@@ -0,0 +1,250 @@
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <xdrpp/record_file.h>
+
+using namespace std;
+using namespace xdr;
+
+static string
+tmpfile_name()
+{
+  char path[] = "/tmp/xdrpp-recordXXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    perror("mkstemp");
+    exit(1);
+  }
+  close(fd);
+  return path;
+}
+
+static msg_ptr
+copy_msg(const msg_ptr &m)
+{
+  msg_ptr c = message_t::alloc(m->size());
+  memcpy(c->data(), m->data(), m->size());
+  return c;
+}
+
+static void
+write_file(const string &path, const vector<msg_ptr> &msgs, size_t trunc = 0)
+{
+  FILE *f = fopen(path.c_str(), "w");
+  assert(f);
+  for (const msg_ptr &m : msgs)
+    fwrite(m->raw_data(), 1, m->raw_size(), f);
+  fclose(f);
+  if (trunc && truncate(path.c_str(), trunc) == -1) {
+    perror("truncate");
+    exit(1);
+  }
+}
+
+int
+main()
+{
+  string path = tmpfile_name();
+
+  vector<msg_ptr> msgs;
+  size_t total = 0;
+  for (uint32_t i = 0; i < 1000; i++) {
+    msgs.push_back(xdr_to_msg(i, xstring<>(string(i % 37, 'a' + i % 26))));
+    total += msgs.back()->raw_size();
+  }
+  write_file(path, msgs);
+
+  xstring_view<> keep;
+  {
+    record_reader r(path);
+    assert(r.file_size() == total);
+
+    // Sequential scan
+    r.advise_sequential();
+    uint32_t n = 0;
+    for (const auto &rec : r) {
+      uint32_t i;
+      xstring<> s;
+      r.decode(rec, i, s);
+      assert(i == n++);
+      assert(s == string(i % 37, 'a' + i % 26));
+    }
+    assert(n == msgs.size());
+
+    // Random access
+    r.advise_random();
+    r.build_index();
+    assert(r.nrecords() == msgs.size());
+    for (uint32_t i : {999u, 0u, 500u, 37u}) {
+      uint32_t j;
+      xstring_view<> s;
+      r.decode(r[i], j, s);
+      assert(j == i);
+      assert(string_view(s) == string(i % 37, 'a' + i % 26));
+      if (i == 37)
+	keep = s;
+    }
+    assert(keep.empty());
+    r.decode(r[38], n, keep);
+    assert(n == 38);
+  }
+  // Views keep the mapping alive
+  assert(string_view(keep) == string(1, 'a' + 12));
+
+  // Truncated files are detected
+  write_file(path, msgs, total - 2);
+  {
+    record_reader r(path);
+    bool ok = false;
+    try { r.build_index(); }
+    catch (const xdr_bad_message_size &) { ok = true; }
+    assert(ok);
+    assert(!r.indexed());
+  }
+
+  // Empty file
+  write_file(path, {});
+  {
+    record_reader r(path);
+    assert(r.begin() == r.end());
+    r.build_index();
+    assert(r.nrecords() == 0);
+  }
+
+  // Parallel decoding of an in-memory buffer
+  {
+    shared_ptr<char> buf(static_cast<char *>(malloc(total)), free);
+    char *p = buf.get();
+    for (const msg_ptr &m : msgs) {
+      memcpy(p, m->raw_data(), m->raw_size());
+      p += m->raw_size();
+    }
+    record_reader r(buf, total);
+    using rec_t = tuple<uint32_t, xstring<>>;
+    for (unsigned nthreads : {1, 3, 8}) {
+      vector<rec_t> v = parallel_decode<rec_t>(r, nthreads);
+      assert(v.size() == msgs.size());
+      for (uint32_t i = 0; i < v.size(); i++) {
+	assert(get<0>(v[i]) == i);
+	assert(get<1>(v[i]) == string(i % 37, 'a' + i % 26));
+      }
+
+      vector<vector<rec_t>> u = parallel_decode_unordered<rec_t>(r, nthreads);
+      assert(u.size() == nthreads);
+      size_t n = 0, sum = 0;
+      for (const auto &w : u)
+	for (const rec_t &e : w) {
+	  ++n;
+	  sum += get<0>(e);
+	}
+      assert(n == msgs.size());
+      assert(sum == msgs.size() * (msgs.size() - 1) / 2);
+    }
+
+    // Errors propagate
+    bool ok = false;
+    try { parallel_decode<uint32_t>(r, 4); }
+    catch (const xdr_bad_message_size &) { ok = true; }
+    assert(ok);
+  }
+
+  // Group commit through record_writer
+  unlink(path.c_str());
+  string ipath = path + ".idx";
+  {
+    vector<record_writer::batch_stats> batches;
+    record_writer w(path, ipath);
+    w.set_stats_cb([&](const record_writer::batch_stats &s) {
+	batches.push_back(s);
+      });
+
+    // Commit on every append by default
+    uint64_t off = w.append(copy_msg(msgs[0]));
+    assert(off == 0);
+    assert(batches.size() == 1 && batches[0].records == 1);
+    assert(batches[0].bytes == msgs[0]->raw_size());
+
+    // Wait for the window or batch size
+    w.set_commit_window(chrono::hours(1));
+    w.set_batch_bytes(4096);
+    size_t before = batches.size();
+    for (size_t i = 1; i < msgs.size(); i++) {
+      off = w.append(copy_msg(msgs[i]));
+      assert(off == w.offset() - msgs[i]->raw_size());
+    }
+    assert(batches.size() > before + 1);
+    assert(batches.size() < before + 100);
+    assert(w.pending() > 0);
+    w.commit();
+    assert(!w.pending());
+    size_t nrec = 0;
+    for (const auto &b : batches) {
+      nrec += b.records;
+      assert(b.writes >= 1);
+      assert(b.latency >= b.sync_time);
+    }
+    assert(nrec == msgs.size());
+
+    // A timeout commits stragglers
+    pollset ps;
+    w.attach(ps);
+    w.set_commit_window(chrono::milliseconds(5));
+    before = batches.size();
+    w.append(xdr_to_msg(uint32_t(1000), xstring<>("last")));
+    assert(w.pending() == 1);
+    while (ps.pending())
+      ps.poll();
+    assert(!w.pending());
+    assert(batches.size() == before + 1);
+
+    // A commit that fails partway keeps its records, and the timeout
+    // reports the error rather than throwing
+    signal(SIGXFSZ, SIG_IGN);
+    rlimit rl, lim;
+    getrlimit(RLIMIT_FSIZE, &rl);
+    lim = rl;
+    lim.rlim_cur = w.offset() + 8;
+    setrlimit(RLIMIT_FSIZE, &lim);
+    before = batches.size();
+    off = w.append(xdr_to_msg(uint32_t(1001), xstring<>("retried")));
+    while (!w.error())
+      ps.poll();
+    assert(w.pending() == 1 && batches.size() == before);
+    bool threw = false;
+    try { w.commit(); }
+    catch (const xdr_system_error &) { threw = true; }
+    assert(threw && w.pending() == 1);
+    // The timeout keeps retrying until the commit succeeds
+    assert(ps.pending());
+    setrlimit(RLIMIT_FSIZE, &rl);
+    while (ps.pending())
+      ps.poll();
+    assert(!w.error() && !w.pending() && batches.size() == before + 1);
+    assert(w.offset() == off + batches.back().bytes);
+  }
+  {
+    record_reader r(path);
+    r.load_index(ipath);
+    assert(r.nrecords() == msgs.size() + 2);
+    for (uint32_t i : {1001u, 1000u, 3u, 999u}) {
+      uint32_t j;
+      xstring<> s;
+      r.decode(r[i], j, s);
+      assert(j == i);
+    }
+  }
+  unlink(ipath.c_str());
+  unlink(path.c_str());
+
+  bool ok = false;
+  try { record_reader r(path); }
+  catch (const xdr_system_error &) { ok = true; }
+  assert(ok);
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <xdrpp/marshal.h>
+#include "tests/xdrtest.hh"
+
+using namespace std;
+
+// Count global heap allocations, for checking steady-state decoding.
+// This replaces the allocator for the whole program, so it lives in
+// its own test.
+static size_t alloc_count;
+void *
+operator new(size_t n)
+{
+  ++alloc_count;
+  if (void *p = malloc(n ? n : 1))
+    return p;
+  throw bad_alloc();
+}
+void *
+operator new(size_t n, align_val_t a)
+{
+  ++alloc_count;
+  if (void *p = aligned_alloc(size_t(a), (max(n, size_t(1)) + size_t(a) - 1)
+			      & ~(size_t(a) - 1)))
+    return p;
+  throw bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { free(p); }
+
+test_recursive
+make_recursive(int depth, int fanout, size_t len)
+{
+  test_recursive t;
+  t.elem = string(len, 'r');
+  if (depth > 0) {
+    for (int i = 0; i < fanout; i++)
+      t.nextvec.push_back(make_recursive(depth - 1, fanout + i, len + i));
+    if (fanout & 1)
+      t.next.activate() = make_recursive(depth - 1, 1, len * 2);
+  }
+  return t;
+}
+
+void
+test_reuse()
+{
+  // A stream of requests with the same structure but varying numbers
+  // of elements and optional values
+  vector<test_recursive> vals;
+  for (int fanout : {4, 1, 6, 0, 3, 6, 2})
+    vals.push_back(make_recursive(2, fanout, 12));
+  vector<xdr::msg_ptr> msgs;
+  for (const auto &v : vals)
+    msgs.push_back(xdr::xdr_to_msg(v));
+
+  auto decode_all = [&](test_recursive &dst, xdr::reuse_cache *cache) {
+    size_t start = alloc_count;
+    for (size_t i = 0; i < msgs.size(); i++) {
+      if (cache)
+	xdr::xdr_from_msg_reuse(msgs[i], *cache, dst);
+      else
+	xdr::xdr_from_msg(msgs[i], dst);
+      assert(dst == vals[i]);
+    }
+    return alloc_count - start;
+  };
+
+  test_recursive plain;
+  for (int i = 0; i < 4; i++)
+    decode_all(plain, nullptr);
+  assert(decode_all(plain, nullptr) > 0);
+
+  xdr::reuse_cache cache;
+  test_recursive scratch;
+  // Capacities only grow, so allocation must eventually stop
+  int warmup = 0;
+  while (decode_all(scratch, &cache) && warmup < 20)
+    ++warmup;
+  assert(warmup < 20);
+  assert(decode_all(scratch, &cache) == 0);
+  assert(decode_all(scratch, &cache) == 0);
+}
+int
+main()
+{
+  test_reuse();
+  return 0;
+}
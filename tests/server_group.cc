@@ -0,0 +1,95 @@
+
+#include <cassert>
+#include <string>
+#include <xdrpp/arpc.h>
+#include <xdrpp/srpc.h>
+#include "tests/xdrtest.hh"
+
+using namespace std;
+using namespace xdr;
+
+using namespace testns;
+
+using mode = rpc_tcp_group_common::mode;
+
+class xdrtest2_server {
+public:
+  using rpc_interface_type = xdrtest2;
+
+  std::atomic<int> calls {0};
+
+  void null2(reply_cb<void> cb) { ++calls; cb(); }
+  void nonnull2(const u_4_12 &arg, reply_cb<ContainsEnum> cb) {
+    ++calls;
+    ContainsEnum c(::RED);
+    c.foo() = to_string(arg.f12().i);
+    cb(c);
+  }
+  void ut(const uniontest &, reply_cb<void>) {}
+  void three(const bool &, const int &, const bigstr &, reply_cb<bigstr>) {}
+};
+
+uint64_t
+total(const vector<rpc_listener_stats> &v, uint64_t rpc_listener_stats::*f)
+{
+  uint64_t n = 0;
+  for (auto &s : v)
+    n += s.*f;
+  return n;
+}
+
+void
+test_group(mode m, size_t nthreads)
+{
+  constexpr int nclients = 12;
+  xdrtest2_server s;
+  vector<unique_sock> fds;	// Outlives g, to destroy it with clients
+  arpc_tcp_group<> g(nthreads, nullptr, m);
+  assert(g.size() == nthreads && g.get_mode() == m);
+  g.register_service(s);
+  g.start();
+
+  string port = to_string(g.port());
+  for (int i = 0; i < nclients; i++) {
+    fds.push_back(tcp_connect("localhost", port.c_str()));
+    srpc_client<xdrtest2> c{fds.back().get()};
+    c.null2();
+    u_4_12 u(12);
+    u.f12().i = i;
+    auto r = c.nonnull2(u);
+    assert(r->foo() == to_string(i));
+  }
+  assert(s.calls == 2 * nclients);
+
+  auto st = g.stats();
+  assert(st.size() == nthreads);
+  assert(total(st, &rpc_listener_stats::accepted) == nclients);
+  assert(total(st, &rpc_listener_stats::active) == nclients);
+  assert(total(st, &rpc_listener_stats::calls) == 2 * nclients);
+  if (m == mode::Acceptor)
+    for (auto &x : st)
+      assert(x.accepted == nclients / nthreads);
+
+  // Stopping closes connections still open
+  g.stop();
+  assert(total(g.stats(), &rpc_listener_stats::active) == 0);
+  fds.clear();
+
+  // The group can be restarted, and destroyed with a client connected
+  g.start();
+  fds.push_back(tcp_connect("localhost", port.c_str()));
+  srpc_client<xdrtest2> c{fds.back().get()};
+  c.null2();
+  assert(s.calls == 2 * nclients + 1);
+}
+
+int
+main()
+{
+  test_group(mode::Acceptor, 3);
+  test_group(mode::Acceptor, 1);
+#ifdef SO_REUSEPORT
+  test_group(mode::ReusePort, 4);
+#endif // SO_REUSEPORT
+  return 0;
+}
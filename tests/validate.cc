@@ -2,7 +2,9 @@
 #include <iomanip>
 #include <iostream>
 #include <xdrpp/marshal.h>
+#include <xdrpp/partial.h>
 #include <xdrpp/printer.h>
+#include <xdrpp/validate.h>
 
 // Forward declaration before including xdrtest.hh. This is necessary for GCC
 // to pick up our local test validate function properly.
@@ -25,9 +27,191 @@ validate(const fix_4 &f4)
     throw xdr::xdr_invariant_failed("fix_4::i has value 0");
 }
 
+template<typename T> bool
+unmarshals(const msg_ptr &m)
+{
+  try {
+    T t;
+    xdr_from_msg(m, t);
+    return true;
+  }
+  catch (const xdr_runtime_error &) {
+    return false;
+  }
+}
+
+// xdr_validate must agree with xdr_from_msg on t and on every
+// message obtained by overwriting one word of it or truncating it.
+template<typename T> void
+check_validator(const T &t)
+{
+  msg_ptr m = xdr_to_msg(t);
+  assert(xdr_validate<T>(m));
+  uint32_t *words = reinterpret_cast<uint32_t *>(m->data());
+  for (size_t i = 0; i < m->size() / 4; i++) {
+    uint32_t orig = words[i];
+    for (uint32_t w : {0u, 1u, 2u, 3u, 0xffffffffu, 0x80u, 0x01000000u}) {
+      words[i] = w;
+      assert(xdr_validate<T>(m) == unmarshals<T>(m));
+    }
+    words[i] = orig;
+  }
+  while (m->size()) {
+    m->shrink(m->size() - 4);
+    assert(xdr_validate<T>(m) == unmarshals<T>(m));
+  }
+}
+
+void
+test_validator()
+{
+  testns::numerics n {true, -1, 2, -3, 4, 5.0, 6.0, testns::REDDER};
+  check_validator(n);
+
+  testns::hasbytes hb;
+  for (int i = 0; i < 3; i++) {
+    testns::bytes &b = hb.the_bytes.emplace_back();
+    b.s = string(5 * i, 's');
+    b.fixed.fill(i);
+    b.variable.resize(i + 1);
+  }
+  check_validator(hb);
+  check_validator(hb.the_bytes[2]);
+
+  test_recursive tr;
+  tr.elem = "top";
+  tr.next.activate().elem = "next";
+  tr.nextvec.emplace_back().elem = "v0";
+  tr.nextvec.emplace_back().nextvec.resize(2);
+  check_validator(tr);
+
+  testns::other_union ou;
+  ou.oc(testns::REDDER).reder_string() = "redder";
+  check_validator(ou);
+
+  testns::uniontest ut;
+  ut.ip.activate() = 7;
+  ut.key.arbitrary(::REDDEST).big() = {1, 2, 3, 4, 5};
+  check_validator(ut);
+  ut.key.arbitrary(::RED).medium() = 99;
+  check_validator(ut);
+
+  testns::unionvoidtest uv;
+  uv.arbitrary(::REDDER);
+  check_validator(uv);
+
+  testns::ContainsEnum ce;
+  ce.c(::REDDER).num() = testns::ContainsEnum::TWO;
+  check_validator(ce);
+
+  sunion su;
+  su.d(SE_NEGATIVE).neg() = true;
+  check_validator(su);
+
+  uptr up;
+  up.b(true).val().activate() = 3;
+  check_validator(up);
+
+  testns::nested_cereal_adapter_calls nc;
+  nc.strptr.activate() = "ptr";
+  nc.strvec = {"a", "bc", "def"};
+  nc.strarr[1] = "arr";
+  check_validator(nc);
+
+  testns::outer o;
+  o.in.f = 5;
+  check_validator(o);
+
+  msg_ptr m;
+
+  // Nesting deeper than the stack limit
+  test_recursive deep;
+  test_recursive *tp = &deep;
+  for (int i = 0; i < 10; i++)
+    tp = &tp->next.activate();
+  m = xdr_to_msg(deep);
+  assert(xdr_validate<test_recursive>(m));
+  uint32_t old_limit = marshaling_stack_limit;
+  marshaling_stack_limit = 5;
+  assert(!xdr_validate<test_recursive>(m));
+  assert(!unmarshals<test_recursive>(m));
+  marshaling_stack_limit = old_limit;
+
+  // Several values in one message
+  m = xdr_to_msg(n, ou, uint32_t(5));
+  assert((xdr_validate<testns::numerics, testns::other_union, uint32_t>(m)));
+  assert((!xdr_validate<testns::numerics, testns::other_union>(m)));
+}
+
+void
+test_partial()
+{
+  testns::bytes b;
+  b.s = "hello";
+  b.fixed.fill(7);
+  b.variable = {1, 2, 3};
+  msg_ptr m = xdr_to_msg(b);
+
+  auto off = xdr_field_offsets<testns::bytes>(m);
+  static_assert(off.size() == 4);
+  assert(off[0] == 0);
+  assert(off[1] == 12);
+  assert(off[2] == 28);
+  assert(off[3] == m->size());
+
+  xdr_lazy<testns::bytes> lb(xdr_to_msg(b));
+  assert(lb.offset<&testns::bytes::variable>() == 28);
+  assert(lb.get<&testns::bytes::variable>() == b.variable);
+  assert(lb.get<&testns::bytes::s>() == b.s);
+  assert(lb.get<&testns::bytes::fixed>() == b.fixed);
+  testns::bytes b2;
+  lb.decode(b2);
+  assert(b2 == b);
+
+  // Fields past a malformed one cannot be located, but earlier ones
+  // can still be read.
+  testns::uniontest ut;
+  ut.ip.activate() = 5;
+  ut.key.arbitrary(::REDDEST).big() = {1, 2, 3, 4, 5};
+  m = xdr_to_msg(ut);
+  m->shrink(m->size() - 4);
+  xdr_lazy<testns::uniontest> lut(std::move(m));
+  assert(*lut.get<&testns::uniontest::ip>() == 5);
+  assert(lut.offset<&testns::uniontest::key>() == 8);
+  assert(lut.lazy<&testns::uniontest::key>().discriminant() == ::REDDEST);
+  bool ok = false;
+  try { lut.get<&testns::uniontest::key>(); }
+  catch (const xdr_overflow &) { ok = true; }
+  assert(ok);
+
+  // The skipping archive ignores enum tags and padding
+  testns::numerics n {true, -1, 2, -3, 4, 5.0, 6.0, testns::REDDER};
+  m = xdr_to_msg(n, b);
+  reinterpret_cast<uint32_t *>(m->data())[10] = 0xffffffff;
+  m->data()[44 + 4 + 5] = 1;
+  assert((!xdr_validate<testns::numerics, testns::bytes>(m)));
+  xdr_skip s(m);
+  s.value<testns::numerics>();
+  s.value<testns::bytes>();
+  s.done();
+
+  // Nested structs
+  testns::outer o;
+  o.in.f = 42;
+  xdr_lazy<testns::outer> lo(xdr_to_msg(o));
+  assert(lo.lazy<&testns::outer::in>().get<&testns::inner::f>() == 42);
+
+  // Unions
+  xdr_lazy<testns::other_union> lou(xdr_to_msg(testns::other_union{}));
+  assert(lou.discriminant() == testns::RED);
+}
+
 int
 main()
 {
+  test_validator();
+  test_partial();
+
   fix_4 f4;
   opaque_vec<> v;
 
@@ -0,0 +1,56 @@
+
+#include <cassert>
+#include <unordered_set>
+#include <xdrpp/marshal.h>
+#include <xdrpp/printer.h>
+#include "tests/viewtest.hh"
+
+using namespace std;
+using namespace viewtest;
+
+int
+main()
+{
+  // Fields generated with -view are views; fixed-size opaque is not
+  static_assert(is_same_v<decltype(object::name), xdr::xstring_view<>>);
+  static_assert(is_same_v<decltype(object::digest), xdr::opaque_array<8>>);
+  static_assert(is_same_v<decltype(object::tags),
+		xdr::xvector<xdr::xstring_view<16>>>);
+
+  // Build a value to send from owning buffers
+  xdr::xstring<> name("object name");
+  xdr::opaque_vec<> blob(100000, 0xab);
+  xdr::xstring<16> tag0("red"), tag1("blue");
+  object o;
+  o.name = name;
+  o.digest.fill(7);
+  o.body.k(LARGE).blob() = blob;
+  o.tags.emplace_back(tag0);
+  o.tags.emplace_back(tag1);
+
+  xdr::shared_msg_ptr m {xdr::xdr_to_msg(o)};
+  object r;
+  xdr::xdr_from_msg(m, r);
+  assert(r == o);
+  assert(xdr::xdr_to_string(r) == xdr::xdr_to_string(o));
+  assert(hash<object>{}(r) == hash<object>{}(o));
+
+  // The blob was not copied, and outlives the message pointer
+  const char *p = reinterpret_cast<const char *>(r.body.blob().data());
+  assert(p > m->data() && p < m->end());
+  assert(r.body.blob().owner() == m);
+  m.reset();
+  assert(r.body.blob().vec() == blob);
+  assert(string_view(r.tags[1]) == "blue");
+
+  // Bounds are still enforced
+  xdr::xvector<xdr::xstring<>> longtags {"seventeen bytes!!"};
+  bool ok = false;
+  try {
+    xdr::xdr_from_msg(xdr::xdr_to_msg(name, o.digest, o.body, longtags), r);
+  }
+  catch (const xdr::xdr_overflow &) { ok = true; }
+  assert(ok);
+
+  return 0;
+}
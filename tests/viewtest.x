@@ -0,0 +1,25 @@
+/* Compiled with xdrc -view for tests/view.cc */
+
+namespace viewtest {
+%using xdr::operator==;
+%using xdr::operator<=>;
+
+enum kind { SMALL = 1, LARGE = 2 };
+
+typedef string tag<16>;
+
+union payload switch (kind k) {
+ case SMALL:
+  opaque bytes<64>;
+ case LARGE:
+  opaque blob<>;
+};
+
+struct object {
+  string name<>;
+  opaque digest[8];
+  payload body;
+  tag tags<>;
+};
+
+}
@@ -49,6 +49,15 @@ indenter nl;
 vec<string> scope;
 vec<string> namespaces;
 std::ostringstream top_material;
+std::ostringstream hash_material;
+
+void
+gen_hash(const string &type)
+{
+  hash_material
+    << "template<> struct hash<" << type << ">" << endl
+    << "  : xdr::xdr_hasher<" << type << "> {};" << endl;
+}
 
 string
 cur_ns()
@@ -98,26 +107,30 @@ string
 decl_type(const rpc_decl &d)
 {
   string type = map_type(d.type);
+  // Namespace for variable-size types
+  string ns = opt_pmr ? "xdr::pmr::" : "xdr::";
 
   if (type == "string")
-    return string("xdr::xstring<") + d.bound + ">";
+    return opt_view ? "xdr::xstring_view<" + d.bound + ">"
+      : ns + "xstring<" + d.bound + ">";
   if (d.type == "opaque")
     switch (d.qual) {
     case rpc_decl::ARRAY:
       return string("xdr::opaque_array<") + d.bound + ">";
     case rpc_decl::VEC:
-      return string("xdr::opaque_vec<") + d.bound + ">";
+      return opt_view ? "xdr::opaque_view<" + d.bound + ">"
+	: ns + "opaque_vec<" + d.bound + ">";
     default:
       assert(!"bad opaque qualifier");
     }
 
   switch (d.qual) {
   case rpc_decl::PTR:
-    return string("xdr::pointer<") + type + ">";
+    return ns + "pointer<" + type + ">";
   case rpc_decl::ARRAY:
     return string("xdr::xarray<") + type + "," + d.bound + ">";
   case rpc_decl::VEC:
-    return string("xdr::xvector<") + type +
+    return ns + "xvector<" + type +
       (d.bound.empty() ? ">" : string(",") + d.bound + ">");
   default:
     return type;
@@ -248,6 +261,7 @@ gen(std::ostream &os, const rpc_struct &s)
     top_material << "  }" << endl;
   }
   top_material << "};" << endl;
+  gen_hash(cur_scope());
 
   scope.pop_back();
 }
@@ -465,6 +479,19 @@ gen(std::ostream &os, const rpc_union &u)
   os << nl.close << "}"
      << endl;
 
+  // _xdr_field_types
+  os << nl << "using _xdr_field_types = std::tuple<";
+  bool firstarm {true};
+  for (const rpc_ufield &f : u.fields)
+    if (f.decl.type != "void") {
+      if (firstarm)
+	firstarm = false;
+      else
+	os << ",";
+      os << nl << "  " << decl_type(f.decl);
+    }
+  os << ">;" << endl;
+
   // _xdr_discriminant
   //os << nl << "using _xdr_discriminant_t = " << u.tagtype << ";";
   os << nl << "_xdr_case_type _xdr_discriminant() const { return "
@@ -673,6 +700,7 @@ gen(std::ostream &os, const rpc_union &u)
     << "  }" << endl;
   top_material
     << "};" << endl;
+  gen_hash(cur_scope());
 
   os << nl.close << "}";
 
@@ -773,6 +801,11 @@ gen_vers(std::ostream &os, const rpc_program &u, const rpc_vers &v)
      << nl << "return false;"
      << nl.close << "}";
 
+  os << nl << "using _xdr_procs = std::tuple<";
+  for (size_t i = 0; i < v.procs.size(); ++i)
+    os << (i ? ", " : "") << v.procs[i].id << "_t";
+  os << ">;";
+
   // client
   os << endl
      << nl << "template<typename _XDR_INVOKER> struct _xdr_client {";
@@ -889,6 +922,12 @@ gen_hh(std::ostream &os)
       os << top_material.str();
       top_material.str("");
       os << "}";
+      if (!hash_material.str().empty()) {
+	os << " namespace std {" << nl;
+	os << hash_material.str();
+	hash_material.str("");
+	os << "}";
+      }
       for (const std::string &ns : namespaces)
 	os << " namespace " << ns << " {";
       os << nl;
@@ -20,6 +20,8 @@ string server_session;
 bool server_ptr;
 bool server_async;
 bool opt_pedantic;
+bool opt_pmr;
+bool opt_view;
 
 string
 guard_token(const string &extra)
@@ -96,6 +98,9 @@ and OPTIONAL arguments for -server{hh,cc} can contain:
       -s[ession] T  Use type T to track client sessions
       -p[tr]        To accept arguments by std::unique_ptr
       -a[sync]      To generate arpc server scaffolding (with callbacks)
+and OPTIONAL arguments for -hh can contain:
+      -pmr          To use std::pmr allocator-aware containers
+      -view         To decode variable-length opaque and string as views
 )";
   exit(err);
 }
@@ -107,6 +112,8 @@ enum opttag {
   OPT_SERVERHH,
   OPT_SERVERCC,
   OPT_PEDANTIC,
+  OPT_PMR,
+  OPT_VIEW,
 };
 
 static const struct option xdrc_options[] = {
@@ -119,6 +126,8 @@ static const struct option xdrc_options[] = {
   {"session", required_argument, nullptr, 's'},
   {"async", no_argument, nullptr, 'a'},
   {"pedantic", no_argument, nullptr, OPT_PEDANTIC},
+  {"pmr", no_argument, nullptr, OPT_PMR},
+  {"view", no_argument, nullptr, OPT_VIEW},
   {nullptr, 0, nullptr, 0}
 };
 
@@ -177,6 +186,12 @@ main(int argc, char **argv)
     case OPT_PEDANTIC:
       opt_pedantic = true;
       break;
+    case OPT_PMR:
+      opt_pmr = true;
+      break;
+    case OPT_VIEW:
+      opt_view = true;
+      break;
     case 'p':
       server_ptr = true;
       break;
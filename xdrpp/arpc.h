@@ -218,6 +218,11 @@ template<typename Session = void,
 using arpc_tcp_listener =
   generic_rpc_tcp_listener<arpc_service, Session, SessionAllocator>;
 
+template<typename Session = void,
+	 typename SessionAllocator = session_allocator<Session>>
+using arpc_tcp_group =
+  generic_rpc_tcp_group<arpc_service, Session, SessionAllocator>;
+
 } // namespace xdr
 
 #endif // !_XDRPP_ARPC_H_HEADER_INCLUDED_
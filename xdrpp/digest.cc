@@ -0,0 +1,233 @@
+
+#include <cstring>
+#include <xdrpp/digest.h>
+
+namespace xdr {
+
+namespace {
+inline std::uint32_t
+rotr32(std::uint32_t x, unsigned n)
+{
+  return x >> n | x << (32 - n);
+}
+
+inline std::uint64_t
+rotl64(std::uint64_t x, unsigned n)
+{
+  return x << n | x >> (64 - n);
+}
+
+inline std::uint32_t
+load32be(const unsigned char *p)
+{
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return swap32le(v);
+}
+
+inline std::uint32_t
+load32le(const unsigned char *p)
+{
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return swap32be(v);
+}
+
+inline std::uint64_t
+load64le(const unsigned char *p)
+{
+  std::uint64_t v;
+  std::memcpy(&v, p, 8);
+  return swap64be(v);
+}
+
+const std::uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr std::uint64_t xxh_p1 = 0x9e3779b185ebca87ULL;
+constexpr std::uint64_t xxh_p2 = 0xc2b2ae3d27d4eb4fULL;
+constexpr std::uint64_t xxh_p3 = 0x165667b19e3779f9ULL;
+constexpr std::uint64_t xxh_p4 = 0x85ebca77c2b2ae63ULL;
+constexpr std::uint64_t xxh_p5 = 0x27d4eb2f165667c5ULL;
+
+inline std::uint64_t
+xxh_round(std::uint64_t acc, std::uint64_t input)
+{
+  acc += input * xxh_p2;
+  return rotl64(acc, 31) * xxh_p1;
+}
+
+inline std::uint64_t
+xxh_merge(std::uint64_t acc, std::uint64_t v)
+{
+  acc ^= xxh_round(0, v);
+  return acc * xxh_p1 + xxh_p4;
+}
+}
+
+void
+sha256::reset()
+{
+  static const std::uint32_t init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+  std::memcpy(h_, init, sizeof(h_));
+  len_ = 0;
+}
+
+void
+sha256::compress(const unsigned char *block)
+{
+  std::uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+    w[i] = load32be(block + 4*i);
+  for (int i = 16; i < 64; i++) {
+    std::uint32_t s0 = rotr32(w[i-15], 7) ^ rotr32(w[i-15], 18) ^ w[i-15] >> 3;
+    std::uint32_t s1 = rotr32(w[i-2], 17) ^ rotr32(w[i-2], 19) ^ w[i-2] >> 10;
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+
+  std::uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3],
+    e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+  for (int i = 0; i < 64; i++) {
+    std::uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+    std::uint32_t ch = (e & f) ^ (~e & g);
+    std::uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+    std::uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+    std::uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    std::uint32_t t2 = s0 + maj;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  h_[0] += a; h_[1] += b; h_[2] += c; h_[3] += d;
+  h_[4] += e; h_[5] += f; h_[6] += g; h_[7] += h;
+}
+
+void
+sha256::update(const void *data, std::size_t n)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  std::size_t used = len_ % 64;
+  len_ += n;
+  if (used) {
+    std::size_t k = std::min(n, 64 - used);
+    std::memcpy(buf_ + used, p, k);
+    p += k;
+    n -= k;
+    if (used + k < 64)
+      return;
+    compress(buf_);
+  }
+  for (; n >= 64; p += 64, n -= 64)
+    compress(p);
+  std::memcpy(buf_, p, n);
+}
+
+sha256::result_type
+sha256::digest()
+{
+  std::uint64_t bits = len_ * 8;
+  static const unsigned char pad[64] = { 0x80 };
+  update(pad, 1 + (119 - len_ % 64) % 64);
+  unsigned char lenbuf[8];
+  for (int i = 0; i < 8; i++)
+    lenbuf[i] = bits >> (56 - 8*i);
+  update(lenbuf, 8);
+
+  result_type out;
+  for (int i = 0; i < 8; i++)
+    for (int j = 0; j < 4; j++)
+      out[4*i + j] = h_[i] >> (24 - 8*j);
+  reset();
+  return out;
+}
+
+void
+xxhash64::reset()
+{
+  v_[0] = seed_ + xxh_p1 + xxh_p2;
+  v_[1] = seed_ + xxh_p2;
+  v_[2] = seed_;
+  v_[3] = seed_ - xxh_p1;
+  len_ = 0;
+}
+
+void
+xxhash64::update(const void *data, std::size_t n)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  std::size_t used = len_ % 32;
+  len_ += n;
+  if (used) {
+    std::size_t k = std::min(n, 32 - used);
+    std::memcpy(buf_ + used, p, k);
+    p += k;
+    n -= k;
+    if (used + k < 32)
+      return;
+    for (int i = 0; i < 4; i++)
+      v_[i] = xxh_round(v_[i], load64le(buf_ + 8*i));
+  }
+  for (; n >= 32; p += 32, n -= 32)
+    for (int i = 0; i < 4; i++)
+      v_[i] = xxh_round(v_[i], load64le(p + 8*i));
+  std::memcpy(buf_, p, n);
+}
+
+xxhash64::result_type
+xxhash64::digest()
+{
+  std::uint64_t h;
+  if (len_ >= 32) {
+    h = rotl64(v_[0], 1) + rotl64(v_[1], 7)
+      + rotl64(v_[2], 12) + rotl64(v_[3], 18);
+    for (int i = 0; i < 4; i++)
+      h = xxh_merge(h, v_[i]);
+  }
+  else
+    h = seed_ + xxh_p5;
+  h += len_;
+
+  const unsigned char *p = buf_, *e = buf_ + len_ % 32;
+  for (; p + 8 <= e; p += 8) {
+    h ^= xxh_round(0, load64le(p));
+    h = rotl64(h, 27) * xxh_p1 + xxh_p4;
+  }
+  if (p + 4 <= e) {
+    h ^= load32le(p) * xxh_p1;
+    h = rotl64(h, 23) * xxh_p2 + xxh_p3;
+    p += 4;
+  }
+  for (; p < e; p++) {
+    h ^= *p * xxh_p5;
+    h = rotl64(h, 11) * xxh_p1;
+  }
+
+  h ^= h >> 33;
+  h *= xxh_p2;
+  h ^= h >> 29;
+  h *= xxh_p3;
+  h ^= h >> 32;
+  reset();
+  return h;
+}
+
+}
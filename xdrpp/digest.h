@@ -0,0 +1,204 @@
+// -*- C++ -*-
+
+/** \file digest.h Hashing the marshaled form of XDR types.
+ * xdr::xdr_digest feeds exactly the bytes xdr::xdr_to_opaque would
+ * produce into an incremental hash function, without ever holding
+ * more than a small block of them.  Any type with
+ * <tt>update(const void *, std::size_t)</tt> and \c digest() methods
+ * can serve as the hash function; xdr::sha256 and the much faster but
+ * non-cryptographic xdr::xxhash64 are provided.
+ */
+
+#ifndef _XDRPP_DIGEST_H_HEADER_INCLUDED_
+#define _XDRPP_DIGEST_H_HEADER_INCLUDED_ 1
+
+#include <array>
+#include <xdrpp/marshal.h>
+
+namespace xdr {
+
+//! Incremental SHA-256 (FIPS 180-4).
+class sha256 {
+  std::uint32_t h_[8];
+  std::uint64_t len_ {0};	// Bytes hashed so far
+  unsigned char buf_[64];
+
+  void compress(const unsigned char *block);
+
+public:
+  using result_type = std::array<std::uint8_t, 32>;
+
+  sha256() { reset(); }
+  void reset();
+  void update(const void *data, std::size_t n);
+  //! The hash of everything passed to \c update since construction
+  //! or the last \c reset.  Resets the object for reuse.
+  result_type digest();
+};
+
+//! Incremental 64-bit xxHash (XXH64), suitable for hash tables and
+//! detecting accidental changes, but not for adversarial inputs.
+class xxhash64 {
+  std::uint64_t v_[4];
+  std::uint64_t len_ {0};
+  std::uint64_t seed_;
+  unsigned char buf_[32];
+
+public:
+  using result_type = std::uint64_t;
+
+  explicit xxhash64(std::uint64_t seed = 0) : seed_(seed) { reset(); }
+  void reset();
+  void update(const void *data, std::size_t n);
+  //! As with xdr::sha256, also resets the object.
+  result_type digest();
+};
+
+//! Archive that marshals into an incremental hash function \c H
+//! instead of a buffer.  Values are marshaled into a small staging
+//! block that is handed to \c H::update whenever it fills, while
+//! large opaque and string bodies bypass it and are passed to \c H
+//! directly.  Call \c flush when done.
+template<typename Base, typename H> struct xdr_generic_hash : Base {
+  using Base::put32;
+  using Base::put64;
+  using Base::put_bytes;
+  using Base::put32_block;
+  using Base::put64_block;
+
+  static constexpr std::size_t stage_words = 64;
+
+  H &h_;
+  std::uint32_t stage_[stage_words];
+  std::uint32_t *p_ {stage_};
+  std::uint32_t *const e_ {stage_ + stage_words};
+
+  explicit xdr_generic_hash(H &h) : h_(h) {}
+  xdr_generic_hash(const xdr_generic_hash &) = delete;
+  xdr_generic_hash &operator=(const xdr_generic_hash &) = delete;
+
+  //! Pass any staged bytes to the hash function.
+  void flush() {
+    if (p_ != stage_) {
+      h_.update(stage_, 4 * (p_ - stage_));
+      p_ = stage_;
+    }
+  }
+
+  //! Ensure room to stage \c n bytes, which must be at most the size
+  //! of the staging block.
+  void check(std::size_t n) {
+    if (n > std::size_t(reinterpret_cast<char *>(e_)
+			- reinterpret_cast<char *>(p_)))
+      flush();
+  }
+
+  template<typename T> typename std::enable_if<
+    std::is_same<std::uint32_t, typename xdr_traits<T>::uint_type>::value>::type
+  operator()(T t) { check(4); put32(p_, xdr_traits<T>::to_uint(t)); }
+
+  template<typename T> typename std::enable_if<
+    std::is_same<std::uint64_t, typename xdr_traits<T>::uint_type>::value>::type
+  operator()(T t) { check(8); put64(p_, xdr_traits<T>::to_uint(t)); }
+
+  template<typename T> typename std::enable_if<xdr_traits<T>::is_bytes>::type
+  operator()(const T &t) {
+    const std::size_t n = t.size();
+    if (xdr_traits<T>::variable_nelem) {
+      check(4);
+      put32(p_, size32(n));
+    }
+    if (n <= 4 * stage_words) {
+      check(n);
+      put_bytes(p_, t.data(), n);
+    }
+    else {
+      flush();
+      h_.update(t.data(), n);
+      if (n & 3) {
+	static constexpr char zero_pad[4] = {};
+	h_.update(zero_pad, 4 - (n & 3));
+      }
+    }
+  }
+
+  template<typename T> typename std::enable_if<
+    xdr_traits<T>::is_class || xdr_traits<T>::is_container>::type
+  operator()(const T &t) {
+    if (!marshal_base::stack_limit--)
+      throw xdr_stack_overflow("stack overflow in xdr_generic_hash");
+    if constexpr (fits_stage<T>()) {
+      check(xdr_traits<T>::fixed_size);
+      xdr_generic_put<Base, false> u(p_, e_);
+      u.stack_limit = marshal_base::stack_limit;
+      u.save_contents(t);
+      p_ = u.p_;
+    }
+    else if constexpr (detail::is_numeric_block<T>::value)
+      put_numeric_block(t);
+    else
+      xdr_traits<T>::save(*this, t);
+    ++marshal_base::stack_limit;
+  }
+
+  //! True if \c T has a fixed size no larger than the staging block.
+  template<typename T> static constexpr bool fits_stage() {
+    if constexpr (xdr_traits<T>::has_fixed_size)
+      return xdr_traits<T>::fixed_size <= 4 * stage_words;
+    else
+      return false;
+  }
+
+  //! Marshal a vector or array of numbers a staging block at a time.
+  template<typename T> void put_numeric_block(const T &t) {
+    using value_type = typename T::value_type;
+    constexpr std::size_t vsize = xdr_traits<value_type>::fixed_size;
+    const std::size_t n = t.size();
+    if (xdr_traits<T>::variable_nelem) {
+      check(4);
+      put32(p_, size32(n));
+    }
+    for (std::size_t i = 0; i < n;) {
+      check(vsize);
+      std::size_t k = std::min<std::size_t>(
+	n - i, (reinterpret_cast<char *>(e_)
+		- reinterpret_cast<char *>(p_)) / vsize);
+      if constexpr (vsize == 4)
+	put32_block(p_, t.data() + i, k);
+      else
+	put64_block(p_, t.data() + i, k);
+      i += k;
+    }
+  }
+};
+
+#if XDRPP_WORDS_BIGENDIAN
+template<typename H> using xdr_hash = xdr_generic_hash<marshal_noswap, H>;
+#else // !XDRPP_WORDS_BIGENDIAN
+//! Archive for hashing values in RFC4506 big-endian order.
+template<typename H> using xdr_hash = xdr_generic_hash<marshal_swap, H>;
+#endif // !XDRPP_WORDS_BIGENDIAN
+
+//! Feed the marshaled form of one or a series of XDR types to \c h.
+template<typename H, typename...Args> void
+xdr_hash_update(H &h, const Args &...args)
+{
+  xdr_hash<H> a(h);
+  xdr_argpack_archive(a, args...);
+  a.flush();
+}
+
+//! Hash the marshaled form of one or a series of XDR types with a
+//! default-constructed \c H.  The result is the same as hashing the
+//! output of <tt>xdr_to_opaque(args...)</tt>.
+template<typename H, typename...Args> typename H::result_type
+xdr_digest(const Args &...args)
+{
+  H h;
+  xdr_hash_update(h, args...);
+  return h.digest();
+}
+
+}
+
+#endif // !_XDRPP_DIGEST_H_HEADER_INCLUDED_
@@ -0,0 +1,225 @@
+// -*- C++ -*-
+
+/** \file iovec_put.h Scatter-gather marshaling.  Instead of copying
+ * every byte into one contiguous xdr::message_t, xdr::xdr_iovec_put
+ * copies small values into a staging buffer but references large
+ * opaque and string bodies in place.  The result, an xdr::iovec_msg,
+ * can be handed to xdr::msg_sock::putmsg, which passes the segments
+ * straight to \c writev.
+ */
+
+#ifndef _XDRPP_IOVEC_PUT_H_HEADER_INCLUDED_
+#define _XDRPP_IOVEC_PUT_H_HEADER_INCLUDED_ 1
+
+#include <vector>
+#include <xdrpp/marshal.h>
+
+namespace xdr {
+
+//! Opaque and string bodies at least this long are referenced in
+//! place rather than copied by xdr::xdr_iovec_put.
+constexpr std::size_t iovec_put_threshold = 512;
+
+//! A marshaled record (4-byte record mark followed by XDR data) held
+//! as a list of segments.  Some segments point into a private staging
+//! buffer, others directly into the objects that were marshaled.
+//! Those objects must therefore outlive the \c iovec_msg, for
+//! instance by passing ownership of them to \c iovec_msg::hold.
+class iovec_msg {
+  template<typename> friend struct xdr_generic_iovec_put;
+
+  struct segment {
+    const void *ext;		// External bytes, or nullptr for staging
+    std::size_t off;		// Byte offset into stage_ (if !ext)
+    std::size_t len;
+  };
+
+  std::unique_ptr<std::uint32_t[]> stage_;
+  std::size_t stage_cap_ {0};	// In 4-byte words
+  std::vector<segment> segs_;
+  std::vector<iovec> iov_;
+  std::size_t size_ {0};
+  std::size_t raw_size_ {0};
+  std::size_t nfrags_ {1};
+  std::vector<std::shared_ptr<const void>> holds_;
+
+  void make_iov();
+  void finish(std::size_t stage_words);
+  void set_fragments(const iovec *iov, std::size_t iovcnt,
+		     std::size_t fragsize);
+
+public:
+  iovec_msg() = default;
+  iovec_msg(iovec_msg &&) = default;
+  iovec_msg &operator=(iovec_msg &&) = default;
+
+  //! Size of the XDR data, not counting the 4-byte record mark.
+  std::size_t size() const { return size_; }
+  //! Size of the data plus all record marks.
+  std::size_t raw_size() const { return raw_size_; }
+  //! Number of record fragments (each with its own record mark).
+  std::size_t fragments() const { return nfrags_; }
+  //! Segments, beginning with the record mark, suitable for \c writev.
+  const iovec *iov() const { return iov_.data(); }
+  std::size_t iovcnt() const { return iov_.size(); }
+
+  //! Send a message as a sequence of RFC5531 record fragments of at
+  //! most \c fragsize bytes each.  Neither function copies the data.
+  static iovec_msg fragmented(msg_ptr &&m, std::size_t fragsize);
+  static iovec_msg fragmented(shared_msg_ptr m, std::size_t fragsize);
+  static iovec_msg fragmented(iovec_msg &&m, std::size_t fragsize);
+
+  //! Keep \c p alive as long as this message, typically because it
+  //! owns bytes referenced by one of the segments.
+  void hold(std::shared_ptr<const void> p) { holds_.push_back(std::move(p)); }
+
+  //! Copy the segments into a contiguous xdr::message_t.  Only valid
+  //! for messages with a single fragment.
+  msg_ptr flatten() const;
+};
+
+//! Archive that marshals into an xdr::iovec_msg.  Numeric values and
+//! small opaque and string fields are copied into the message's
+//! staging buffer (which grows as needed), while opaque and string
+//! bodies of at least \c threshold bytes become segments of their
+//! own.  Call \c finish when done.
+template<typename Base> struct xdr_generic_iovec_put : Base {
+  using Base::put32;
+  using Base::put64;
+  using Base::put_bytes;
+
+  iovec_msg &m_;
+  const std::size_t threshold_;
+  std::uint32_t *p_;
+  std::uint32_t *e_;
+  std::size_t run_start_ {0};	// Word offset of current staged run
+
+  explicit xdr_generic_iovec_put(iovec_msg &m,
+				 std::size_t threshold = iovec_put_threshold)
+    : m_(m), threshold_(threshold) {
+    m_.segs_.clear();
+    if (m_.stage_cap_ < 16) {
+      m_.stage_.reset(new std::uint32_t[16]);
+      m_.stage_cap_ = 16;
+    }
+    p_ = m_.stage_.get() + 1;	// Leave room for the record mark
+    e_ = m_.stage_.get() + m_.stage_cap_;
+  }
+
+  //! Ensure room for \c n more bytes in the staging buffer.
+  void check(std::size_t n) {
+    if (n > std::size_t(reinterpret_cast<char *>(e_)
+			- reinterpret_cast<char *>(p_)))
+      grow(n);
+  }
+
+  template<typename T> typename std::enable_if<
+    std::is_same<std::uint32_t, typename xdr_traits<T>::uint_type>::value>::type
+  operator()(T t) { check(4); put32(p_, xdr_traits<T>::to_uint(t)); }
+
+  template<typename T> typename std::enable_if<
+    std::is_same<std::uint64_t, typename xdr_traits<T>::uint_type>::value>::type
+  operator()(T t) { check(8); put64(p_, xdr_traits<T>::to_uint(t)); }
+
+  template<typename T> typename std::enable_if<xdr_traits<T>::is_bytes>::type
+  operator()(const T &t) {
+    const std::size_t n = t.size();
+    if (n && n >= threshold_) {
+      if (xdr_traits<T>::variable_nelem) {
+	check(4);
+	put32(p_, size32(n));
+      }
+      end_run();
+      m_.segs_.push_back({t.data(), 0, n});
+      if (n & 3)
+	m_.segs_.push_back({zero_pad_, 0, 4 - (n & 3)});
+    }
+    else {
+      if (xdr_traits<T>::variable_nelem) {
+	check(4 + n);
+	put32(p_, size32(n));
+      }
+      else
+	check(n);
+      put_bytes(p_, t.data(), n);
+    }
+  }
+
+  template<typename T> typename std::enable_if<
+    xdr_traits<T>::is_class || xdr_traits<T>::is_container>::type
+  operator()(const T &t) {
+    if (!marshal_base::stack_limit--)
+      throw xdr_stack_overflow("stack overflow in xdr_generic_iovec_put");
+    if constexpr (xdr_traits<T>::has_fixed_size) {
+      check(xdr_traits<T>::fixed_size);
+      put_unchecked(t);
+    }
+    else if constexpr (detail::is_numeric_block<T>::value) {
+      check(4 + t.size() * xdr_traits<typename T::value_type>::fixed_size);
+      put_unchecked(t);
+    }
+    else
+      xdr_traits<T>::save(*this, t);
+    ++marshal_base::stack_limit;
+  }
+
+  //! Finalize the record mark and segment list.
+  void finish() {
+    end_run();
+    m_.finish(p_ - m_.stage_.get());
+  }
+
+private:
+  static constexpr char zero_pad_[4] = {};
+
+  // Space has already been checked, so use a plain unchecked archive
+  // on the staging buffer.
+  template<typename T> void put_unchecked(const T &t) {
+    xdr_generic_put<Base, false> u(p_, e_);
+    u.stack_limit = marshal_base::stack_limit;
+    u.save_contents(t);
+    p_ = u.p_;
+  }
+
+  void end_run() {
+    std::size_t pos = p_ - m_.stage_.get();
+    if (pos > run_start_)
+      m_.segs_.push_back({nullptr, 4*run_start_, 4*(pos - run_start_)});
+    run_start_ = pos;
+  }
+
+  void grow(std::size_t n) {
+    std::size_t used = p_ - m_.stage_.get();
+    std::size_t cap = std::max(2*m_.stage_cap_, used + (n + 3)/4);
+    std::unique_ptr<std::uint32_t[]> stage(new std::uint32_t[cap]);
+    std::memcpy(stage.get(), m_.stage_.get(), 4*used);
+    m_.stage_ = std::move(stage);
+    m_.stage_cap_ = cap;
+    p_ = m_.stage_.get() + used;
+    e_ = m_.stage_.get() + cap;
+  }
+};
+
+#if XDRPP_WORDS_BIGENDIAN
+using xdr_iovec_put = xdr_generic_iovec_put<marshal_noswap>;
+#else // !XDRPP_WORDS_BIGENDIAN
+//! Scatter-gather archive for marshaling in RFC4506 big-endian order.
+using xdr_iovec_put = xdr_generic_iovec_put<marshal_swap>;
+#endif // !XDRPP_WORDS_BIGENDIAN
+
+//! Marshal one or a series of XDR types into an xdr::iovec_msg.  Large
+//! opaque and string bodies in \c args are referenced, not copied, so
+//! \c args must outlive the result (see \c iovec_msg::hold).
+template<typename...Args> iovec_msg
+xdr_to_iovec_msg(const Args &...args)
+{
+  iovec_msg m;
+  xdr_iovec_put p(m);
+  xdr_argpack_archive(p, args...);
+  p.finish();
+  return m;
+}
+
+}
+
+#endif // !_XDRPP_IOVEC_PUT_H_HEADER_INCLUDED_
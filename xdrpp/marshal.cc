@@ -1,14 +1,318 @@
 
-#include <xdrpp/marshal.h>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <vector>
+#include <xdrpp/iovec_put.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define XDRPP_X86_SIMD 1
+#include <immintrin.h>
+#endif // x86 && __GNUC__
 
 namespace xdr {
 
 std::uint32_t marshaling_stack_limit = 0xffffffff;
 
 namespace detail {
+std::uint32_t
+record_mark(std::size_t size, bool last)
+{
+  // Records too large for one fragment cannot have a meaningful mark,
+  // and must instead be sent with iovec_msg::fragmented.
+  if (size >= 0x80000000)
+    return 0;
+  return swap32le(std::uint32_t(size) | (last ? 0x80000000 : 0));
+}
+
+namespace {
+// Pooled message buffers come in power-of-two size classes from 64
+// bytes to 64 KiB, including the message_t header.  Each thread
+// caches up to pool_max_cached free buffers of each class.
+constexpr unsigned pool_min_shift = 6;
+constexpr unsigned pool_nclasses = 11;
+constexpr std::size_t pool_max_size =
+  std::size_t(1) << (pool_min_shift + pool_nclasses - 1);
+constexpr unsigned pool_max_cached = 64;
+static_assert(pool_max_size == message_t::pool_max_size,
+	      "message_t::pool_max_size must match the largest size class");
+static_assert(sizeof(message_t) + message_t::small_size <= pool_max_size,
+	      "small messages must fit in a pool size class");
+
+std::atomic<bool> pool_enabled {false};
+
+inline std::size_t
+pool_class_size(unsigned cls)
+{
+  return std::size_t(1) << (pool_min_shift + cls);
+}
+
+inline unsigned
+pool_class(std::size_t total)
+{
+  unsigned w = std::bit_width(total - 1);
+  return w > pool_min_shift ? w - pool_min_shift : 0;
+}
+
+struct pool_counters {
+  std::atomic<std::uint64_t> hits {0};
+  std::atomic<std::uint64_t> misses {0};
+  std::atomic<std::uint64_t> recycled {0};
+  std::atomic<std::uint64_t> released {0};
+
+  // Counters of a thread cache are only written by their own thread,
+  // so avoid the cost of a locked read-modify-write.
+  static void bump(std::atomic<std::uint64_t> &c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  void add_to(message_pool_stats &s) const {
+    s.hits += hits.load(std::memory_order_relaxed);
+    s.misses += misses.load(std::memory_order_relaxed);
+    s.recycled += recycled.load(std::memory_order_relaxed);
+    s.released += released.load(std::memory_order_relaxed);
+  }
+};
+
+struct thread_cache;
+std::mutex pool_mutex;
+std::vector<thread_cache *> pool_threads;
+// Counters from threads that have exited (only touched under
+// pool_mutex) or that no longer have a cache (atomic adds).
+pool_counters pool_orphan_counters;
+
+thread_local bool thread_cache_gone;
+
+struct thread_cache {
+  void *head_[pool_nclasses] {};
+  unsigned count_[pool_nclasses] {};
+  pool_counters counters_;
+
+  thread_cache() {
+    std::lock_guard<std::mutex> lk(pool_mutex);
+    pool_threads.push_back(this);
+  }
+  ~thread_cache() {
+    for (unsigned cls = 0; cls < pool_nclasses; ++cls)
+      while (void *p = head_[cls]) {
+	head_[cls] = *static_cast<void **>(p);
+	std::free(p);
+      }
+    std::lock_guard<std::mutex> lk(pool_mutex);
+    message_pool_stats s {};
+    counters_.add_to(s);
+    pool_orphan_counters.hits += s.hits;
+    pool_orphan_counters.misses += s.misses;
+    pool_orphan_counters.recycled += s.recycled;
+    pool_orphan_counters.released += s.released;
+    std::erase(pool_threads, this);
+    thread_cache_gone = true;
+  }
+
+  static thread_cache *get() {
+    if (thread_cache_gone)
+      return nullptr;
+    thread_local thread_cache tc;
+    return &tc;
+  }
+};
+
+void *
+pool_get(unsigned cls)
+{
+  thread_cache *tc = thread_cache::get();
+  if (tc && tc->head_[cls]) {
+    void *p = tc->head_[cls];
+    tc->head_[cls] = *static_cast<void **>(p);
+    --tc->count_[cls];
+    pool_counters::bump(tc->counters_.hits);
+    return p;
+  }
+  if (tc)
+    pool_counters::bump(tc->counters_.misses);
+  else
+    ++pool_orphan_counters.misses;
+  return std::malloc(pool_class_size(cls));
+}
+
+void
+pool_put(unsigned cls, void *p)
+{
+  thread_cache *tc = thread_cache::get();
+  if (tc && tc->count_[cls] < pool_max_cached) {
+    *static_cast<void **>(p) = tc->head_[cls];
+    tc->head_[cls] = p;
+    ++tc->count_[cls];
+    pool_counters::bump(tc->counters_.recycled);
+    return;
+  }
+  if (tc)
+    pool_counters::bump(tc->counters_.released);
+  else
+    ++pool_orphan_counters.released;
+  std::free(p);
+}
+} // namespace
+
 void free_message_t::operator()(message_t *p) {
+  std::uint8_t cls = p->pool_class_;
   p->~message_t();
-  free(p);
+  if (cls == message_t::no_pool)
+    free(p);
+  else
+    pool_put(cls, p);
+}
+
+namespace {
+using bswap_fn = void (*)(void *, const void *, std::size_t);
+
+void
+bswap32_scalar(void *dst, const void *src, std::size_t n)
+{
+  char *d = static_cast<char *>(dst);
+  const char *s = static_cast<const char *>(src);
+  for (std::size_t i = 0; i < n; ++i, d += 4, s += 4) {
+    std::uint32_t v;
+    std::memcpy(&v, s, 4);
+    v = swap32(v);
+    std::memcpy(d, &v, 4);
+  }
+}
+
+void
+bswap64_scalar(void *dst, const void *src, std::size_t n)
+{
+  char *d = static_cast<char *>(dst);
+  const char *s = static_cast<const char *>(src);
+  for (std::size_t i = 0; i < n; ++i, d += 8, s += 8) {
+    std::uint64_t v;
+    std::memcpy(&v, s, 8);
+    v = swap64(v);
+    std::memcpy(d, &v, 8);
+  }
+}
+
+#if XDRPP_X86_SIMD
+// Both buffers are only guaranteed 4-byte alignment, so all vector
+// loads and stores are unaligned.  The tail (fewer than one vector's
+// worth of elements) falls through to the scalar code.
+
+__attribute__((target("ssse3"))) void
+bswap_ssse3(__m128i mask, char *&d, const char *&s, std::size_t &bytes)
+{
+  for (; bytes >= 16; bytes -= 16, d += 16, s += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(d), _mm_shuffle_epi8(v, mask));
+  }
+}
+
+__attribute__((target("avx2"))) void
+bswap_avx2(__m256i mask, char *&d, const char *&s, std::size_t &bytes)
+{
+  for (; bytes >= 32; bytes -= 32, d += 32, s += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(d),
+			_mm256_shuffle_epi8(v, mask));
+  }
+}
+
+__attribute__((target("ssse3"))) void
+bswap32_ssse3(void *dst, const void *src, std::size_t n)
+{
+  char *d = static_cast<char *>(dst);
+  const char *s = static_cast<const char *>(src);
+  std::size_t bytes = 4*n;
+  bswap_ssse3(_mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+			    11, 10, 9, 8, 15, 14, 13, 12), d, s, bytes);
+  bswap32_scalar(d, s, bytes/4);
+}
+
+__attribute__((target("ssse3"))) void
+bswap64_ssse3(void *dst, const void *src, std::size_t n)
+{
+  char *d = static_cast<char *>(dst);
+  const char *s = static_cast<const char *>(src);
+  std::size_t bytes = 8*n;
+  bswap_ssse3(_mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+			    15, 14, 13, 12, 11, 10, 9, 8), d, s, bytes);
+  bswap64_scalar(d, s, bytes/8);
+}
+
+__attribute__((target("avx2"))) void
+bswap32_avx2(void *dst, const void *src, std::size_t n)
+{
+  char *d = static_cast<char *>(dst);
+  const char *s = static_cast<const char *>(src);
+  std::size_t bytes = 4*n;
+  bswap_avx2(_mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+			      11, 10, 9, 8, 15, 14, 13, 12,
+			      3, 2, 1, 0, 7, 6, 5, 4,
+			      11, 10, 9, 8, 15, 14, 13, 12), d, s, bytes);
+  bswap32_scalar(d, s, bytes/4);
+}
+
+__attribute__((target("avx2"))) void
+bswap64_avx2(void *dst, const void *src, std::size_t n)
+{
+  char *d = static_cast<char *>(dst);
+  const char *s = static_cast<const char *>(src);
+  std::size_t bytes = 8*n;
+  bswap_avx2(_mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+			      15, 14, 13, 12, 11, 10, 9, 8,
+			      7, 6, 5, 4, 3, 2, 1, 0,
+			      15, 14, 13, 12, 11, 10, 9, 8), d, s, bytes);
+  bswap64_scalar(d, s, bytes/8);
+}
+#endif // XDRPP_X86_SIMD
+
+// 0 = scalar only, 1 = SSSE3, 2 = AVX2
+int
+simd_level()
+{
+#if XDRPP_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return 2;
+  if (__builtin_cpu_supports("ssse3"))
+    return 1;
+#endif // XDRPP_X86_SIMD
+  return 0;
+}
+} // namespace
+
+void
+bswap32_block(void *dst, const void *src, std::size_t n)
+{
+  static const bswap_fn f = [] {
+    switch (simd_level()) {
+#if XDRPP_X86_SIMD
+    case 2:
+      return bswap32_avx2;
+    case 1:
+      return bswap32_ssse3;
+#endif // XDRPP_X86_SIMD
+    default:
+      return bswap32_scalar;
+    }
+  }();
+  f(dst, src, n);
+}
+
+void
+bswap64_block(void *dst, const void *src, std::size_t n)
+{
+  static const bswap_fn f = [] {
+    switch (simd_level()) {
+#if XDRPP_X86_SIMD
+    case 2:
+      return bswap64_avx2;
+    case 1:
+      return bswap64_ssse3;
+#endif // XDRPP_X86_SIMD
+    default:
+      return bswap64_scalar;
+    }
+  }();
+  f(dst, src, n);
 }
 } // namespace detail
 
@@ -17,19 +321,80 @@ message_t::alloc(std::size_t size)
 {
   // In RPC (see RFC5531 section 11), the high bit means this is the
   // last record fragment in a record.  If the high bit is clear, it
-  // means another fragment follows.  We don't currently implement
-  // continuation fragments, and instead always set the last-record
-  // bit to produce a single-fragment record.
-  assert(size < 0x80000000);
-  void *raw = std::malloc(sizeof(message_t) + size);
+  // means another fragment follows.  A message_t always holds a whole
+  // record, so we set the last-record bit to make it a single
+  // fragment.  (msg_sock splits messages too big for that.)
+  std::size_t total = sizeof(message_t) + size;
+  std::uint8_t cls = no_pool;
+  void *raw;
+  if (size <= small_size
+      || (total <= detail::pool_max_size
+	  && detail::pool_enabled.load(std::memory_order_relaxed))) {
+    cls = detail::pool_class(total);
+    raw = detail::pool_get(cls);
+  }
+  else
+    raw = std::malloc(total);
   if (!raw)
     throw std::bad_alloc();
-  message_t *m = new (raw) message_t (size);
+  message_t *m = new (raw) message_t (size, cls);
   *reinterpret_cast<std::uint32_t *>(m->raw_data()) =
-    swap32le(size32(size) | 0x80000000);
+    detail::record_mark(size, true);
   return msg_ptr(m);
 }
 
+void
+message_t::resize(msg_ptr &m, std::size_t size)
+{
+  if (m->pool_class_ != no_pool) {
+    if (sizeof(message_t) + size
+	<= detail::pool_class_size(m->pool_class_)) {
+      m->size_ = size;
+      *reinterpret_cast<std::uint32_t *>(m->raw_data()) =
+	detail::record_mark(size, true);
+    }
+    else {
+      msg_ptr n = alloc(size);
+      std::memcpy(n->data(), m->data(), std::min(size, m->size_));
+      n->peer_ = std::move(m->peer_);
+      m = std::move(n);
+    }
+    return;
+  }
+  // With peer_ moved out, the header owns nothing, so its bytes can
+  // be relocated by realloc; a new header is then constructed over
+  // them.  The payload follows the header and is copied as raw bytes.
+  std::unique_ptr<sockaddr> peer {std::move(m->peer_)};
+  message_t *p = m.release();
+  void *raw = std::realloc(static_cast<void *>(p), sizeof(message_t) + size);
+  if (!raw) {
+    m.reset(p);
+    m->peer_ = std::move(peer);
+    throw std::bad_alloc();
+  }
+  m.reset(new (raw) message_t (size, no_pool));
+  m->peer_ = std::move(peer);
+  *reinterpret_cast<std::uint32_t *>(m->raw_data()) =
+    detail::record_mark(size, true);
+}
+
+void
+message_t::enable_pool(bool on)
+{
+  detail::pool_enabled.store(on, std::memory_order_relaxed);
+}
+
+message_pool_stats
+message_t::pool_stats()
+{
+  message_pool_stats s {};
+  std::lock_guard<std::mutex> lk(detail::pool_mutex);
+  detail::pool_orphan_counters.add_to(s);
+  for (const detail::thread_cache *tc : detail::pool_threads)
+    tc->counters_.add_to(s);
+  return s;
+}
+
 void
 message_t::shrink(std::size_t newsize)
 {
@@ -37,7 +402,7 @@ message_t::shrink(std::size_t newsize)
     throw std::out_of_range("message_t::shrink new size bigger than old");
   size_ = newsize;
   *reinterpret_cast<std::uint32_t *>(raw_data()) =
-    swap32le(size32(newsize) | 0x80000000);
+    detail::record_mark(newsize, true);
 }
 
 void
@@ -45,9 +410,16 @@ marshal_base::get_bytes(const std::uint32_t *&pr, void *buf, std::size_t len)
 {
   if (!len)
     return;
-  const char *p = reinterpret_cast<const char *>(pr);
-  std::memcpy(buf, p, len);
-  p += len;
+  std::memcpy(buf, pr, len);
+  skip_bytes(pr, len);
+}
+
+void
+marshal_base::skip_bytes(const std::uint32_t *&pr, std::size_t len)
+{
+  if (!len)
+    return;
+  const char *p = reinterpret_cast<const char *>(pr) + len;
   while (len & 3) {
     ++len;
     if (*p++ != '\0')
@@ -71,4 +443,109 @@ marshal_base::put_bytes(std::uint32_t *&pr, const void *buf, std::size_t len)
   pr = reinterpret_cast<std::uint32_t *>(p);
 }
 
+void
+iovec_msg::make_iov()
+{
+  char *stage = reinterpret_cast<char *>(stage_.get());
+  iov_.clear();
+  iov_.reserve(segs_.size());
+  raw_size_ = 0;
+  for (const segment &s : segs_) {
+    const void *base = s.ext ? s.ext : stage + s.off;
+    iov_.push_back({const_cast<void *>(base), s.len});
+    raw_size_ += s.len;
+  }
+}
+
+void
+iovec_msg::finish(std::size_t stage_words)
+{
+  assert(stage_words <= stage_cap_);
+  make_iov();
+  // The first staged run always begins with the record mark.
+  size_ = raw_size_ - 4;
+  nfrags_ = 1;
+  stage_[0] = detail::record_mark(size_, true);
+}
+
+void
+iovec_msg::set_fragments(const iovec *iov, std::size_t iovcnt,
+			 std::size_t fragsize)
+{
+  assert(fragsize > 0 && fragsize < 0x80000000);
+  const iovec *const end = iov + iovcnt;
+  std::size_t off = 0;		// Offset into *iov
+  nfrags_ = size_ ? (size_ + fragsize - 1) / fragsize : 1;
+  stage_.reset(new std::uint32_t[nfrags_]);
+  stage_cap_ = nfrags_;
+  segs_.clear();
+
+  std::size_t left = size_;
+  for (std::size_t f = 0; f < nfrags_; ++f) {
+    std::size_t len = std::min(left, fragsize);
+    left -= len;
+    stage_[f] = detail::record_mark(len, !left);
+    segs_.push_back({nullptr, 4*f, 4});
+    while (len) {
+      assert(iov < end);
+      if (off == iov->iov_len) {
+	++iov;
+	off = 0;
+	continue;
+      }
+      std::size_t n = std::min(len, iov->iov_len - off);
+      segs_.push_back({static_cast<char *>(iov->iov_base) + off, 0, n});
+      off += n;
+      len -= n;
+    }
+  }
+  make_iov();
+}
+
+iovec_msg
+iovec_msg::fragmented(msg_ptr &&m, std::size_t fragsize)
+{
+  return fragmented(shared_msg_ptr(std::move(m)), fragsize);
+}
+
+iovec_msg
+iovec_msg::fragmented(shared_msg_ptr sm, std::size_t fragsize)
+{
+  iovec v {const_cast<char *>(sm->data()), sm->size()};
+  iovec_msg r;
+  r.size_ = sm->size();
+  r.set_fragments(&v, 1, fragsize);
+  r.hold(std::move(sm));
+  return r;
+}
+
+iovec_msg
+iovec_msg::fragmented(iovec_msg &&m, std::size_t fragsize)
+{
+  assert(m.nfrags_ == 1);
+  auto sm = std::make_shared<const iovec_msg>(std::move(m));
+  // Copy the segments, minus the leading record mark
+  std::vector<iovec> v (sm->iov_);
+  v[0].iov_base = static_cast<char *>(v[0].iov_base) + 4;
+  v[0].iov_len -= 4;
+  iovec_msg r;
+  r.size_ = sm->size_;
+  r.set_fragments(v.data(), v.size(), fragsize);
+  r.hold(std::move(sm));
+  return r;
+}
+
+msg_ptr
+iovec_msg::flatten() const
+{
+  assert(nfrags_ == 1);
+  msg_ptr m = message_t::alloc(size_);
+  char *p = m->raw_data();
+  for (const iovec &v : iov_) {
+    std::memcpy(p, v.iov_base, v.iov_len);
+    p += v.iov_len;
+  }
+  return m;
+}
+
 }
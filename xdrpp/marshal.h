@@ -37,11 +37,32 @@ struct marshal_base {
   //! make the total number of bytes consumed divisible by 4.  \throws
   //! xdr_should_be_zero if the padding bytes are not zero.
   static void get_bytes(const std::uint32_t *&pr, void *buf, std::size_t len);
+  //! Like \c get_bytes, but skips over the bytes without copying them.
+  static void skip_bytes(const std::uint32_t *&pr, std::size_t len);
   //! Copy \c len bytes from buf, then add 0-3 zero-valued padding
   //! bytes to make the overall marshaled length a multiple of 4.
   static void put_bytes(std::uint32_t *&pr, const void *buf, std::size_t len);
 };
 
+namespace detail {
+//! True for an xdr::xvector or xdr::xarray of numeric type, which the
+//! marshaling archives can bounds-check once and convert in bulk.
+template<typename T> struct is_numeric_block : std::false_type {};
+template<typename T, std::uint32_t N> struct is_numeric_block<xvector<T,N>>
+  : std::integral_constant<bool, xdr_traits<T>::is_numeric> {};
+template<typename T, std::uint32_t N> struct is_numeric_block<xarray<T,N>>
+  : std::integral_constant<bool, xdr_traits<T>::is_numeric> {};
+template<typename T, std::uint32_t N>
+struct is_numeric_block<pmr::xvector<T,N>>
+  : std::integral_constant<bool, xdr_traits<T>::is_numeric> {};
+
+//! Copy \c n 32-bit words from \c src to \c dst, byteswapping each.
+//! Uses SSSE3 or AVX2 when the CPU supports them.
+void bswap32_block(void *dst, const void *src, std::size_t n);
+//! Copy \c n 64-bit words from \c src to \c dst, byteswapping each.
+void bswap64_block(void *dst, const void *src, std::size_t n);
+} // namespace detail
+
 //! Numeric marshaling mixin that does not byteswap any numeric values
 //! (which will produce RFC4506 output on a big-endian machine).
 struct marshal_noswap : marshal_base {
@@ -58,6 +79,25 @@ struct marshal_noswap : marshal_base {
     u.u32[1] = *p++;
     return u.u64;
   }
+
+  //! Marshal \c n consecutive 32-bit values starting at \c src.
+  static void put32_block(std::uint32_t *&p, const void *src, std::size_t n) {
+    std::memcpy(p, src, 4*n);
+    p += n;
+  }
+  static void put64_block(std::uint32_t *&p, const void *src, std::size_t n) {
+    std::memcpy(p, src, 8*n);
+    p += 2*n;
+  }
+  //! Unmarshal \c n consecutive 32-bit values into \c dst.
+  static void get32_block(const std::uint32_t *&p, void *dst, std::size_t n) {
+    std::memcpy(dst, p, 4*n);
+    p += n;
+  }
+  static void get64_block(const std::uint32_t *&p, void *dst, std::size_t n) {
+    std::memcpy(dst, p, 8*n);
+    p += 2*n;
+  }
 };
 
 //! Numeric marshaling mixin that byteswaps all numeric values (thus
@@ -77,13 +117,36 @@ struct marshal_swap : marshal_base {
     u.u32[0] = swap32(*p++);
     return u.u64;
   }
+
+  static void put32_block(std::uint32_t *&p, const void *src, std::size_t n) {
+    detail::bswap32_block(p, src, n);
+    p += n;
+  }
+  static void put64_block(std::uint32_t *&p, const void *src, std::size_t n) {
+    detail::bswap64_block(p, src, n);
+    p += 2*n;
+  }
+  static void get32_block(const std::uint32_t *&p, void *dst, std::size_t n) {
+    detail::bswap32_block(dst, p, n);
+    p += n;
+  }
+  static void get64_block(const std::uint32_t *&p, void *dst, std::size_t n) {
+    detail::bswap64_block(dst, p, n);
+    p += 2*n;
+  }
 };
 
 //! Archive type for marshaling to a buffer.  Depending on the `Base`
-//! type, will marshal in either big- or little-endian order.
-template<typename Base> struct xdr_generic_put : Base {
+//! type, will marshal in either big- or little-endian order.  When
+//! the archive reaches a struct, tuple, or array with a fixed
+//! marshaled size, it checks for \c fixed_size bytes of space once,
+//! then marshals the contents with an archive whose \c Checked
+//! parameter is \c false and so performs no further bounds checks.
+template<typename Base, bool Checked = true> struct xdr_generic_put : Base {
   using Base::put32;
   using Base::put64;
+  using Base::put32_block;
+  using Base::put64_block;
   using Base::put_bytes;
 
   std::uint32_t *p_;
@@ -102,8 +165,8 @@ template<typename Base> struct xdr_generic_put : Base {
     : xdr_generic_put(m->data(), m->end()) {}
 
   void check(std::size_t n) const {
-    if (n > std::size_t(reinterpret_cast<char *>(e_)
-			- reinterpret_cast<char *>(p_)))
+    if (Checked && n > std::size_t(reinterpret_cast<char *>(e_)
+				   - reinterpret_cast<char *>(p_)))
       throw xdr_overflow("insufficient buffer space in xdr_generic_put");
   }
 
@@ -131,27 +194,77 @@ template<typename Base> struct xdr_generic_put : Base {
   operator()(const T &t) {
     if (!marshal_base::stack_limit--)
       throw xdr_stack_overflow("stack overflow in xdr_generic_put");
-    xdr_traits<T>::save(*this, t);
+    if constexpr (Checked && xdr_traits<T>::has_fixed_size) {
+      check(xdr_traits<T>::fixed_size);
+      xdr_generic_put<Base, false> u(p_, e_, marshal_base::stack_limit);
+      u.save_contents(t);
+      p_ = u.p_;
+    }
+    else
+      save_contents(t);
     ++marshal_base::stack_limit;
   }
+
+  template<typename T> void save_contents(const T &t) {
+    if constexpr (detail::is_numeric_block<T>::value)
+      put_numeric_block(t);
+    else
+      xdr_traits<T>::save(*this, t);
+  }
+
+  //! Marshal a vector or array of numeric values with a single bounds
+  //! check.  Produces the same bytes as marshaling one element at a
+  //! time.
+  template<typename T> void put_numeric_block(const T &t) {
+    using value_type = typename T::value_type;
+    constexpr std::size_t vsize = xdr_traits<value_type>::fixed_size;
+    const std::size_t n = t.size();
+    if (xdr_traits<T>::variable_nelem) {
+      check(4 + n * vsize);
+      put32(p_, size32(n));
+    }
+    else
+      check(n * vsize);
+    if constexpr (vsize == 4)
+      put32_block(p_, t.data(), n);
+    else
+      put64_block(p_, t.data(), n);
+  }
+
+private:
+  template<typename, bool> friend struct xdr_generic_put;
+  xdr_generic_put(std::uint32_t *p, std::uint32_t *e, std::uint32_t limit)
+    : p_(p), e_(e) { marshal_base::stack_limit = limit; }
 };
 
 //! Archive type for unmarshaling from a buffer.  Depending on the
 //! `Base` type, will expect input in either big- or little-endian
-//! order.
-template<typename Base> struct xdr_generic_get : Base {
+//! order.  Like \c xdr_generic_put, checks bounds only once for each
+//! outermost type with a fixed marshaled size.
+template<typename Base, bool Checked = true> struct xdr_generic_get : Base {
   using Base::get32;
   using Base::get64;
+  using Base::get32_block;
+  using Base::get64_block;
   using Base::get_bytes;
+  using Base::skip_bytes;
 
   const std::uint32_t *p_;
   const std::uint32_t *const e_;
+  //! Shared with any xdr::opaque_view or xdr::xstring_view unmarshaled
+  //! by this archive, to keep the underlying buffer alive.
+  std::shared_ptr<const void> owner_;
+  //! When set, vector elements and optional values that a message
+  //! does not use are kept here for reuse rather than destroyed.
+  reuse_cache *reuse_ {nullptr};
 
   // Set the buffer to marshal from.  Both \c start and \c end must be
   // 4-byte aligned.
-  xdr_generic_get(const void *start, const void *end)
+  xdr_generic_get(const void *start, const void *end,
+		  std::shared_ptr<const void> owner = nullptr)
     : p_(reinterpret_cast<const std::uint32_t *>(start)),
-      e_(reinterpret_cast<const std::uint32_t *>(end)) {
+      e_(reinterpret_cast<const std::uint32_t *>(end)),
+      owner_(std::move(owner)) {
     assert(!(reinterpret_cast<intptr_t>(start) & 3));
     // Message could be coming from untrusted source, so bad length is
     // not an assertion failure.
@@ -162,10 +275,12 @@ template<typename Base> struct xdr_generic_get : Base {
   }
   xdr_generic_get(const msg_ptr &m)
     : xdr_generic_get(m->data(), m->end()) {}
+  xdr_generic_get(const shared_msg_ptr &m)
+    : xdr_generic_get(m->data(), m->end(), m) {}
 
   void check(std::size_t n) const {
-    if (n > std::size_t(reinterpret_cast<const char *>(e_)
-			- reinterpret_cast<const char *>(p_)))
+    if (Checked && n > std::size_t(reinterpret_cast<const char *>(e_)
+				   - reinterpret_cast<const char *>(p_)))
       throw xdr_overflow("insufficient buffer space in xdr_generic_get");
   }
 
@@ -184,15 +299,26 @@ template<typename Base> struct xdr_generic_get : Base {
 
   template<typename T> typename std::enable_if<xdr_traits<T>::is_bytes>::type
   operator()(T &t) {
-    if (xdr_traits<T>::variable_nelem) {
+    if constexpr (detail::is_bytes_view<T>::value) {
       check(4);
       std::uint32_t size = get32(p_);
       check(size);
-      t.resize(size);
+      t.check_size(size);
+      t = T(reinterpret_cast<const typename T::value_type *>(p_), size,
+	    owner_);
+      skip_bytes(p_, size);
+    }
+    else {
+      if (xdr_traits<T>::variable_nelem) {
+	check(4);
+	std::uint32_t size = get32(p_);
+	check(size);
+	t.resize(size);
+      }
+      else
+	check(t.size());
+      get_bytes(p_, t.data(), t.size());
     }
-    else
-      check(t.size());
-    get_bytes(p_, t.data(), t.size());
   }
 
   template<typename T> typename std::enable_if<
@@ -200,24 +326,159 @@ template<typename Base> struct xdr_generic_get : Base {
   operator()(T &t) {
     if (!marshal_base::stack_limit--)
       throw xdr_stack_overflow("stack overflow in xdr_generic_get");
-    xdr_traits<T>::load(*this, t);
+    if constexpr (Checked && xdr_traits<T>::has_fixed_size) {
+      check(xdr_traits<T>::fixed_size);
+      xdr_generic_get<Base, false> u(p_, e_, marshal_base::stack_limit);
+      u.load_contents(t);
+      p_ = u.p_;
+    }
+    else
+      load_contents(t);
     ++marshal_base::stack_limit;
   }
 
+  template<typename T> void load_contents(T &t) {
+    if constexpr (detail::is_numeric_block<T>::value)
+      get_numeric_block(t);
+    else
+      xdr_traits<T>::load(*this, t);
+  }
+
+  //! Unmarshal a vector or array of numeric values with a single
+  //! bounds check (which happens before resizing a vector, so a bogus
+  //! length cannot trigger a huge allocation).
+  template<typename T> void get_numeric_block(T &t) {
+    using value_type = typename T::value_type;
+    constexpr std::size_t vsize = xdr_traits<value_type>::fixed_size;
+    std::uint32_t n;
+    if (xdr_traits<T>::variable_nelem) {
+      check(4);
+      n = get32(p_);
+      t.check_size(n);
+      check(std::size_t(n) * vsize);
+      t.resize(n);
+    }
+    else {
+      n = size32(t.size());
+      check(std::size_t(n) * vsize);
+    }
+    if constexpr (vsize == 4)
+      get32_block(p_, t.data(), n);
+    else
+      get64_block(p_, t.data(), n);
+  }
+
   void done() {
     if (p_ != e_)
       throw xdr_bad_message_size("unmarshaling did not consume whole message");
   }
+
+private:
+  template<typename, bool> friend struct xdr_generic_get;
+  xdr_generic_get(const std::uint32_t *p, const std::uint32_t *e,
+		  std::uint32_t limit)
+    : p_(p), e_(e) { marshal_base::stack_limit = limit; }
+};
+
+//! Archive that marshals in a single pass into a message that grows
+//! as needed, rather than sizing the values first with \c
+//! xdr_argpack_size.  Capacity doubles on each growth, so the cost is
+//! amortized linear.  Call \c finish to trim the message to the bytes
+//! actually written and take ownership of it.
+template<typename Base> struct xdr_generic_grow_put : Base {
+  using Base::put32;
+  using Base::put64;
+  using Base::put_bytes;
+
+  msg_ptr m_;
+  std::uint32_t *p_;
+  std::uint32_t *e_;
+
+  explicit xdr_generic_grow_put(std::size_t reserve = 64)
+    : m_(message_t::alloc(reserve & ~std::size_t(3))) {
+    p_ = reinterpret_cast<std::uint32_t *>(m_->data());
+    e_ = reinterpret_cast<std::uint32_t *>(m_->end());
+  }
+
+  //! Ensure room for \c n more bytes.
+  void check(std::size_t n) {
+    if (n > std::size_t(reinterpret_cast<char *>(e_)
+			- reinterpret_cast<char *>(p_)))
+      grow(n);
+  }
+
+  template<typename T> typename std::enable_if<
+    std::is_same<std::uint32_t, typename xdr_traits<T>::uint_type>::value>::type
+  operator()(T t) { check(4); put32(p_, xdr_traits<T>::to_uint(t)); }
+
+  template<typename T> typename std::enable_if<
+    std::is_same<std::uint64_t, typename xdr_traits<T>::uint_type>::value>::type
+  operator()(T t) { check(8); put64(p_, xdr_traits<T>::to_uint(t)); }
+
+  template<typename T> typename std::enable_if<xdr_traits<T>::is_bytes>::type
+  operator()(const T &t) {
+    if (xdr_traits<T>::variable_nelem) {
+      check(4 + t.size());
+      put32(p_, size32(t.size()));
+    }
+    else
+      check(t.size());
+    put_bytes(p_, t.data(), t.size());
+  }
+
+  template<typename T> typename std::enable_if<
+    xdr_traits<T>::is_class || xdr_traits<T>::is_container>::type
+  operator()(const T &t) {
+    if (!marshal_base::stack_limit--)
+      throw xdr_stack_overflow("stack overflow in xdr_generic_grow_put");
+    if constexpr (xdr_traits<T>::has_fixed_size) {
+      check(xdr_traits<T>::fixed_size);
+      put_unchecked(t);
+    }
+    else if constexpr (detail::is_numeric_block<T>::value) {
+      check(4 + t.size() * xdr_traits<typename T::value_type>::fixed_size);
+      put_unchecked(t);
+    }
+    else
+      xdr_traits<T>::save(*this, t);
+    ++marshal_base::stack_limit;
+  }
+
+  //! Trim the message to what has been marshaled and return it.
+  msg_ptr finish() {
+    m_->shrink(reinterpret_cast<char *>(p_) - m_->data());
+    p_ = e_ = nullptr;
+    return std::move(m_);
+  }
+
+private:
+  template<typename T> void put_unchecked(const T &t) {
+    xdr_generic_put<Base, false> u(p_, e_);
+    u.stack_limit = marshal_base::stack_limit;
+    u.save_contents(t);
+    p_ = u.p_;
+  }
+
+  void grow(std::size_t n) {
+    std::size_t used = reinterpret_cast<char *>(p_) - m_->data();
+    std::size_t size = std::max(2*m_->size(), (used + n + 3) & ~std::size_t(3));
+    message_t::resize(m_, size);
+    p_ = reinterpret_cast<std::uint32_t *>(m_->data() + used);
+    e_ = reinterpret_cast<std::uint32_t *>(m_->end());
+  }
 };
 
 #if XDRPP_WORDS_BIGENDIAN
 using xdr_put = xdr_generic_put<marshal_noswap>;
 using xdr_get = xdr_generic_get<marshal_noswap>;
+using xdr_grow_put = xdr_generic_grow_put<marshal_noswap>;
 #else // !XDRPP_WORDS_BIGENDIAN
 //! Archive for marshaling in RFC4506 big-endian order.
 using xdr_put = xdr_generic_put<marshal_swap>;
 //! Archive for unmarshaling in RFC4506 big-endian order.
 using xdr_get = xdr_generic_get<marshal_swap>;
+//! Single-pass archive for marshaling in RFC4506 big-endian order.
+using xdr_grow_put = xdr_generic_grow_put<marshal_swap>;
 #endif // !XDRPP_WORDS_BIGENDIAN
 
 inline std::size_t
@@ -259,6 +520,40 @@ xdr_to_msg(const Args &...args)
   return m;
 }
 
+//! Like xdr::xdr_to_msg, but marshals in a single pass with
+//! xdr::xdr_grow_put instead of computing the size first.  This is
+//! faster for deeply nested variable-size types, at the cost of up to
+//! twice the memory.
+template<typename...Args> msg_ptr
+xdr_to_msg_grow(const Args &...args)
+{
+  xdr_grow_put p;
+  xdr_argpack_archive(p, args...);
+  return p.finish();
+}
+
+//! Like xdr::xdr_to_msg, but for types with a bounded size (see
+//! xdr::xdr_has_bounded_size) skips the sizing pass, instead
+//! allocating a message of the maximum size and shrinking it
+//! afterwards.  When the bound would not fit in a pooled buffer (see
+//! message_t::pool_max_size), this just calls xdr::xdr_to_msg, so
+//! that small values of types like \c opaque<0x10000000> do not
+//! allocate the full bound.
+template<typename...Args> msg_ptr
+xdr_to_msg_bounded(const Args &...args)
+{
+  constexpr std::size_t max = (std::size_t(0) + ... + xdr_max_size<Args>);
+  if constexpr (max > message_t::pool_max_size - sizeof(message_t))
+    return xdr_to_msg(args...);
+  else {
+    msg_ptr m (message_t::alloc(max));
+    xdr_put p (m);
+    xdr_argpack_archive(p, args...);
+    m->shrink(reinterpret_cast<const char *>(p.p_) - m->data());
+    return m;
+  }
+}
+
 //! Marshal one or a series of XDR types into a newly allocated opaque
 //! structure for embedding in other XDR types.
 template<typename...Args> opaque_vec<>
@@ -283,6 +578,30 @@ xdr_from_msg(const msg_ptr &m, Args &...args)
   g.done();
 }
 
+//! Like xdr::xdr_from_msg, but keeps the nested objects and buffers
+//! of \c args alive for the next decode, using \c cache to hold any
+//! that this message does not need.  Meant for decoding a stream of
+//! messages into the same long-lived objects (see xdr::reuse_cache).
+template<typename...Args> void
+xdr_from_msg_reuse(const msg_ptr &m, reuse_cache &cache, Args &...args)
+{
+  xdr_get g(m);
+  g.reuse_ = &cache;
+  xdr_argpack_archive(g, args...);
+  g.done();
+}
+
+//! Like the \c msg_ptr version, but any xdr::opaque_view or
+//! xdr::xstring_view in \c args shares ownership of the message
+//! instead of copying out of it.
+template<typename...Args> void
+xdr_from_msg(const shared_msg_ptr &m, Args &...args)
+{
+  xdr_get g(m);
+  xdr_argpack_archive(g, args...);
+  g.done();
+}
+
 namespace detail {
 // Fake function accepting types we are willing to unmarshal from.
 // Intentionally doesn't work with std::string because strings are not
@@ -22,8 +22,23 @@ namespace detail {
 struct free_message_t {
   void operator()(message_t *p);
 };
+//! RFC5531 record mark (in network byte order) for a fragment of \c
+//! size bytes, or 0 if \c size does not fit in a single fragment.
+std::uint32_t record_mark(std::size_t size, bool last);
 } // namespace detail
 using msg_ptr = std::unique_ptr<message_t, detail::free_message_t>;
+//! Shared, read-only reference to a message.  Construct one by moving
+//! from a \c msg_ptr.
+using shared_msg_ptr = std::shared_ptr<const message_t>;
+
+//! Counters for the optional message buffer pool (see \c
+//! message_t::enable_pool).
+struct message_pool_stats {
+  std::uint64_t hits;		//!< Allocations served from a thread cache
+  std::uint64_t misses;		//!< Allocations that called \c malloc
+  std::uint64_t recycled;	//!< Frees kept in a thread cache
+  std::uint64_t released;	//!< Frees that called \c free
+};
 
 //! Message buffer, with room at beginning for 4-byte length.  Note
 //! the constructor is private, so you must create one with \c
@@ -31,10 +46,15 @@ using msg_ptr = std::unique_ptr<message_t, detail::free_message_t>;
 //! \c message_t structure.  Hence \c message_t is just a data
 //! structure at the beginning of the buffer.
 class message_t {
+  friend struct detail::free_message_t;
+  static constexpr std::uint8_t no_pool = 0xff;
+
   std::unique_ptr<sockaddr> peer_;
   std::size_t size_;
+  std::uint8_t pool_class_;
   alignas(std::uint32_t) char buf_[4];
-  message_t(std::size_t size) : size_(size) {}
+  message_t(std::size_t size, std::uint8_t pool_class)
+    : size_(size), pool_class_(pool_class) {}
 public:
   std::size_t size() const { return size_; }
   void shrink(std::size_t newsize);
@@ -48,7 +68,10 @@ public:
   char *end() { return buf_ + 4 + size_; }
   const char *end() const { return buf_ + 4 + size_; }
 
-  //! 4-byte buffer to store size in network byte order, followed by data.
+  //! 4-byte buffer to store size in network byte order, followed by
+  //! data.  Messages of 2^31 bytes or more do not fit in a single
+  //! record fragment, so their length field is zero (and xdr::msg_sock
+  //! sends them as multiple fragments).
   char *raw_data() { return buf_; }
   const char *raw_data() const { return buf_; }
   //! Size of 4-byte length plus data.
@@ -59,8 +82,29 @@ public:
   //! Returns unique_ptr to peer address so it can be set/moved.
   std::unique_ptr<sockaddr> &&unique_peer() { return std::move(peer_); }
 
+  //! Messages with at most this many bytes of data, such as most
+  //! RPC calls and all fixed-size error replies, always come from the
+  //! per-thread buffer cache, even when the pool is not enabled.
+  static constexpr std::size_t small_size = 192;
+  //! Largest pooled buffer, including the \c message_t header.
+  //! Larger buffers always come from (and return to) the heap.
+  static constexpr std::size_t pool_max_size = 0x10000;
+
   //! Allocate a new buffer.
   static msg_ptr alloc(std::size_t size);
+  //! Change the size of a buffer, possibly moving it.  Existing
+  //! contents are preserved up to the smaller of the two sizes.
+  static void resize(msg_ptr &m, std::size_t size);
+
+  //! Turn on (or off) pooling of message buffers.  When on, buffers
+  //! are allocated in power-of-two size classes and freed buffers are
+  //! cached per thread for reuse, so that steady-state traffic does
+  //! not go to the heap.  Buffers larger than \c pool_max_size are
+  //! never cached.
+  //! Small messages (see \c small_size) are pooled regardless.
+  static void enable_pool(bool on = true);
+  //! Counters summed over all threads since the program started.
+  static message_pool_stats pool_stats();
 };
 
 }
@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstring>
@@ -15,6 +16,12 @@ namespace xdr {
 msg_sock::~msg_sock()
 {
   ps_.fd_cb(s_, pollset::ReadWrite);
+#if XDRPP_HAVE_IO_URING
+  if (wbusy_) {
+    wbatch_->orphans = std::move(wqueue_);
+    ps_.submit_io();
+  }
+#endif // XDRPP_HAVE_IO_URING
   close(s_);
   *destroyed_ = true;
 }
@@ -29,21 +36,34 @@ msg_sock::init()
 void
 msg_sock::initcb()
 {
-  if (rcb_)
+  if (rcb_ || fcb_ || scb_)
     ps_.fd_cb(s_, pollset::Read, [this](){ input(); });
   else
     ps_.fd_cb(s_, pollset::Read);
 }
 
+void
+msg_sock::input_error()
+{
+  if (scb_)
+    scb_(nullptr, 0, true);
+  else if (fcb_)
+    fcb_(nullptr, true);
+  else
+    rcb_(nullptr);
+}
+
 void
 msg_sock::input()
 {
+  if (scb_)
+    return stream_input();
   std::shared_ptr<bool> destroyed{destroyed_};
   for (int i = 0; i < 3 && !*destroyed; i++) {
-    if (rdmsg_) {
+    if (rdbody_) {
       iovec iov[2];
-      iov[0].iov_base = rdmsg_->data() + rdpos_;
-      iov[0].iov_len = rdmsg_->size() - rdpos_;
+      iov[0].iov_base = rdmsg_->data() + rdbase_ + rdpos_;
+      iov[0].iov_len = rdfrag_ - rdpos_;
       iov[1].iov_base = nextlenp();
       iov[1].iov_len = sizeof nextlen_;
       ssize_t n = readv(s_, iov, 2);
@@ -54,16 +74,16 @@ msg_sock::input()
 	  errno = ECONNRESET;
 	else
 	  std::cerr << "msg_sock::input: " << sock_errmsg() << std::endl;
-	rcb_(nullptr);
+	input_error();
 	return;
       }
       rdpos_ += n;
-      if (rdpos_ >= rdmsg_->size()) {
-	rdpos_ -= rdmsg_->size();
-	rcb_(std::move(rdmsg_));
-	if (*destroyed)
-	  return;
-      }
+      if (rdpos_ < rdfrag_)
+	return;
+      rdpos_ -= rdfrag_;
+      rdbody_ = false;
+      if (!end_fragment())
+	return;
     }
     else if (rdpos_ < sizeof nextlen_) {
       ssize_t n = read(s_, nextlenp() + rdpos_, sizeof nextlen_ - rdpos_);
@@ -71,51 +91,152 @@ msg_sock::input()
 	if (n < 0 && eagain(errno))
 	  return;
 	if (n == 0)
-	  errno = rdpos_ ? ECONNRESET : 0;
+	  errno = rdpos_ || rdmsg_ ? ECONNRESET : 0;
 	else
 	  std::cerr << "msg_sock::input: " << sock_errmsg() << std::endl;
-	rcb_(nullptr);
+	input_error();
 	return;
       }
       rdpos_ += n;
     }
 
-    if (rdmsg_ || rdpos_ < sizeof nextlen_)
+    if (rdpos_ < sizeof nextlen_)
       return;
-    size_t len = nextlen();
-    if (!(len & 0x80000000)) {
-      std::cerr << "msgsock: message fragments unimplemented" << std::endl;
-      errno = ECONNRESET;
-      rcb_(nullptr);
+    if (!start_fragment())
+      return;
+  }
+}
+
+// Input for setscb mode.  Here rdfrag_ counts the bytes remaining in
+// the current fragment and rdbase_ those in the record so far.
+void
+msg_sock::stream_input()
+{
+  if (!rdbuf_)
+    rdbuf_.reset(new std::uint32_t[stream_bufsize / 4]);
+  std::shared_ptr<bool> destroyed{destroyed_};
+  for (int i = 0; i < 3 && !*destroyed; i++) {
+    // Keep the buffer's alignment in step with the stream, so that
+    // record bodies land on 4-byte boundaries
+    char *buf = reinterpret_cast<char *>(rdbuf_.get()) + rdskew_;
+    ssize_t n = read(s_, buf, stream_bufsize - rdskew_);
+    if (n <= 0) {
+      if (n < 0 && eagain(errno))
+	return;
+      if (n == 0)
+	errno = rdpos_ || rdbody_ || rdbase_ ? ECONNRESET : 0;
+      else
+	std::cerr << "msg_sock::input: " << sock_errmsg() << std::endl;
+      input_error();
       return;
     }
-    len &= 0x7fffffff;
-    if (!len) {
-      rdpos_ = 0;
-      rcb_(message_t::alloc(0));
-      continue;
-    }
+    bool drained = size_t(n) < stream_bufsize - rdskew_;
+    rdskew_ = (rdskew_ + n) & 3;
+
+    for (const char *p = buf, *e = buf + n; p < e && !*destroyed;) {
+      if (rdbody_) {
+	size_t k = std::min(size_t(e - p), rdfrag_);
+	rdfrag_ -= k;
+	bool eor = !rdfrag_ && rdlast_;
+	if (!rdfrag_) {
+	  rdbody_ = false;
+	  if (eor)
+	    rdbase_ = 0;
+	}
+	scb_(p, k, eor);
+	p += k;
+	continue;
+      }
 
-    if (len <= maxmsglen_) {
-      // Length comes from untrusted source; don't crash if can't alloc
-      try { rdmsg_ = message_t::alloc(len); }
-      catch (const std::bad_alloc &) {
-	std::cerr << "msg_sock: allocation of " << len << "-byte message failed"
-		  << std::endl;
+      size_t k = std::min(size_t(e - p), sizeof nextlen_ - rdpos_);
+      std::memcpy(nextlenp() + rdpos_, p, k);
+      p += k;
+      rdpos_ += k;
+      if (rdpos_ < sizeof nextlen_)
+	break;
+      rdpos_ = 0;
+      size_t len = nextlen();
+      rdlast_ = len & 0x80000000;
+      rdfrag_ = len & 0x7fffffff;
+      if (rdfrag_ > maxmsglen_ - rdbase_) {
+	std::cerr << "msg_sock: rejecting " << rdbase_ + rdfrag_
+		  << "-byte message (too long)" << std::endl;
+	ps_.fd_cb(s_, pollset::Read);
+	errno = E2BIG;
+	input_error();
+	return;
+      }
+      rdbase_ += rdfrag_;
+      if (rdfrag_)
+	rdbody_ = true;
+      else if (rdlast_) {
+	rdbase_ = 0;
+	scb_(p, 0, true);
       }
     }
-    else {
-      std::cerr << "msg_sock: rejecting " << len << "-byte message (too long)"
-		<< std::endl;
-      ps_.fd_cb(s_, pollset::Read);
+    if (drained)
+      return;
+  }
+}
+
+// Called with a complete record mark in nextlen_.  Returns false if
+// input should stop.
+bool
+msg_sock::start_fragment()
+{
+  size_t len = nextlen();
+  rdlast_ = len & 0x80000000;
+  len &= 0x7fffffff;
+  rdpos_ = 0;
+
+  // Bytes of the record already received
+  size_t have = rdmsg_ && !fcb_ ? rdmsg_->size() : 0;
+  if (len <= maxmsglen_ - have) {
+    // Length comes from untrusted source; don't crash if can't alloc
+    try {
+      if (have)
+	message_t::resize(rdmsg_, have + len);
+      else
+	rdmsg_ = message_t::alloc(len);
     }
-    if (rdmsg_)
-      rdpos_ = 0;
-    else {
-      errno = E2BIG;
-      rcb_(nullptr);
+    catch (const std::bad_alloc &) {
+      std::cerr << "msg_sock: allocation of " << have + len
+		<< "-byte message failed" << std::endl;
+      rdmsg_.reset();
     }
   }
+  else {
+    std::cerr << "msg_sock: rejecting " << have + len
+	      << "-byte message (too long)" << std::endl;
+    rdmsg_.reset();
+    ps_.fd_cb(s_, pollset::Read);
+  }
+  if (!rdmsg_) {
+    errno = E2BIG;
+    input_error();
+    return false;
+  }
+
+  rdbase_ = have;
+  rdfrag_ = len;
+  if (len) {
+    rdbody_ = true;
+    return true;
+  }
+  return end_fragment();
+}
+
+// Called when the body of a fragment has been read.  Returns false if
+// the msg_sock was deleted.
+bool
+msg_sock::end_fragment()
+{
+  std::shared_ptr<bool> destroyed{destroyed_};
+  if (fcb_)
+    fcb_(std::move(rdmsg_), rdlast_);
+  else if (rdlast_)
+    rcb_(std::move(rdmsg_));
+  return !*destroyed;
 }
 
 void
@@ -125,14 +246,82 @@ msg_sock::putmsg(msg_ptr &mb)
     mb.reset();
     return;
   }
+  if (mb->size() > fragsize_)
+    return putmsg(iovec_msg::fragmented(std::move(mb), fragsize_));
+  size_t size = mb->raw_size();
+  pushmsg(std::move(mb), size);
+}
 
+void
+msg_sock::putmsg(iovec_msg &&m)
+{
+  if (wfail_)
+    return;
+  if (m.size() > fragsize_ && m.fragments() == 1)
+    m = iovec_msg::fragmented(std::move(m), fragsize_);
+  size_t size = m.raw_size();
+  pushmsg(std::move(m), size);
+}
+
+void
+msg_sock::putmsg(shared_msg_ptr m)
+{
+  if (wfail_)
+    return;
+  if (m->size() > fragsize_)
+    return putmsg(iovec_msg::fragmented(std::move(m), fragsize_));
+  size_t size = m->raw_size();
+  pushmsg(std::move(m), size);
+}
+
+void
+msg_sock::pushmsg(wmsg_t &&m, size_t size)
+{
   bool was_empty = !wsize_;
-  wsize_ += mb->raw_size();
-  wqueue_.emplace_back(mb.release());
+  wsize_ += size;
+  wqueue_.push_back(std::move(m));
   if (was_empty)
     output(false);
 }
 
+size_t
+msg_sock::wmsg_size(const wmsg_t &m)
+{
+  if (auto mp = std::get_if<msg_ptr>(&m))
+    return (*mp)->raw_size();
+  if (auto sp = std::get_if<shared_msg_ptr>(&m))
+    return (*sp)->raw_size();
+  return std::get<iovec_msg>(m).raw_size();
+}
+
+// Fill in up to n iovecs for message m, omitting the first skip bytes.
+// Returns the number of iovecs used.
+size_t
+msg_sock::wmsg_iov(const wmsg_t &m, size_t skip, iovec *v, size_t n)
+{
+  const message_t *mt = nullptr;
+  if (auto mp = std::get_if<msg_ptr>(&m))
+    mt = mp->get();
+  else if (auto sp = std::get_if<shared_msg_ptr>(&m))
+    mt = sp->get();
+  if (mt) {
+    v->iov_len = mt->raw_size() - skip;
+    v->iov_base = const_cast<char *> (mt->raw_data()) + skip;
+    return 1;
+  }
+  const iovec_msg &im = std::get<iovec_msg>(m);
+  const iovec *src = im.iov(), *end = src + im.iovcnt();
+  for (; skip >= src->iov_len; ++src)
+    skip -= src->iov_len;
+  size_t i = 0;
+  for (; i < n && src < end; ++i, ++src) {
+    v[i].iov_len = src->iov_len - skip;
+    v[i].iov_base = static_cast<char *>(src->iov_base) + skip;
+    skip = 0;
+  }
+  return i;
+}
+
 void
 msg_sock::pop_wbytes(size_t n)
 {
@@ -140,37 +329,39 @@ msg_sock::pop_wbytes(size_t n)
     return;
   assert (n <= wsize_);
   wsize_ -= n;
-  size_t frontbytes = wqueue_.front()->raw_size() - wstart_;
+  size_t frontbytes = wmsg_size(wqueue_.front()) - wstart_;
   if (n < frontbytes) {
     wstart_ += n;
     return;
   }
   n -= frontbytes;
   wqueue_.pop_front();
-  while (n > 0 && n >= (frontbytes = wqueue_.front()->raw_size())) {
+  while (n > 0 && n >= (frontbytes = wmsg_size(wqueue_.front()))) {
     n -= frontbytes;
     wqueue_.pop_front();
   }
   wstart_ = n;
 }
 
+// Fill in up to maxiov iovecs for the front of the write queue.
+size_t
+msg_sock::wqueue_iov(iovec *v) const
+{
+  size_t i = 0;
+  for (auto b = wqueue_.begin(); i < maxiov && b != wqueue_.end(); ++b)
+    i += wmsg_iov(*b, b == wqueue_.begin() ? wstart_ : 0, v + i, maxiov - i);
+  return i;
+}
+
 void
 msg_sock::output(bool cbset)
 {
-  static constexpr size_t maxiov = 8;
-  size_t i = 0;
+#if XDRPP_HAVE_IO_URING
+  if (ps_.async_io())
+    return output_async();
+#endif // XDRPP_HAVE_IO_URING
   iovec v[maxiov];
-  for (auto b = wqueue_.begin(); i < maxiov && b != wqueue_.end(); ++b, ++i) {
-    if (i) {
-      v[i].iov_len = (*b)->raw_size();
-      v[i].iov_base = const_cast<char *> ((*b)->raw_data());
-    }
-    else {
-      v[i].iov_len = (*b)->raw_size() - wstart_;
-      v[i].iov_base = const_cast<char *> ((*b)->raw_data()) + wstart_;
-    }
-  }
-  ssize_t n = writev(s_, v, i);
+  ssize_t n = writev(s_, v, wqueue_iov(v));
   if (n <= 0) {
     if (n != -1 || !eagain(errno)) {
       wfail_ = true;
@@ -187,6 +378,42 @@ msg_sock::output(bool cbset)
     ps_.fd_cb(s_, pollset::Write);
 }
 
+#if XDRPP_HAVE_IO_URING
+void
+msg_sock::output_async()
+{
+  if (wbusy_ || !wsize_)
+    return;
+  if (!wbatch_)
+    wbatch_ = std::make_shared<wbatch>();
+  wbusy_ = true;
+  ps_.async_writev(s_, wbatch_->v, wqueue_iov(wbatch_->v),
+		   [this, b = wbatch_, destroyed = destroyed_](long n) {
+		     if (!*destroyed)
+		       output_done(n);
+		   });
+}
+
+void
+msg_sock::output_done(long n)
+{
+  wbusy_ = false;
+  if (n == -EAGAIN || n == -EINTR) {
+    // The socket buffer was full, so wait until it drains
+    ps_.fd_cb(s_, pollset::WriteOnce, [this](){ output_async(); });
+    return;
+  }
+  if (n <= 0) {
+    wfail_ = true;
+    wsize_ = wstart_ = 0;
+    wqueue_.clear();
+    return;
+  }
+  pop_wbytes(n);
+  output_async();
+}
+#endif // XDRPP_HAVE_IO_URING
+
 void
 rpc_sock::abort_all_calls()
 {
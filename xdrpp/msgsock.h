@@ -7,7 +7,8 @@
 #define _XDRPP_MSGSOCK_H_INCLUDED_ 1
 
 #include <deque>
-#include <xdrpp/message.h>
+#include <variant>
+#include <xdrpp/iovec_put.h>
 #include <xdrpp/pollset.h>
 
 namespace xdr {
@@ -15,9 +16,13 @@ namespace xdr {
 //! Send and receive a series of delimited messages on a stream
 //! socket.  The format (specified in RFC5531, Section 11) is simple:
 //! A 4-byte length (in little-endian format) followed by that many
-//! bytes.  The implementation is optimized for having many sockets
-//! each receiving a small number of messages, as opposed to receiving
-//! many messages over the same socket.
+//! bytes.  The high bit of the length is set on the last fragment of
+//! a record; incoming multi-fragment records are reassembled (or
+//! handed over a fragment at a time, see \c setfcb), and outgoing
+//! messages larger than \c set_fragsize are split into fragments.
+//! The implementation is optimized for having many sockets each
+//! receiving a small number of messages, as opposed to receiving many
+//! messages over the same socket.
 //!
 //! Currently this calls read once or twice per message to get the
 //! exact length before allocating buffer space and reading the
@@ -27,7 +32,13 @@ namespace xdr {
 class msg_sock {
 public:
   static constexpr std::size_t default_maxmsglen = 0x100000;
+  //! Largest fragment the record marking standard allows.
+  static constexpr std::size_t max_fragsize = 0x7fffffff;
   using rcb_t = std::function<void(msg_ptr)>;
+  using fcb_t = std::function<void(msg_ptr, bool)>;
+  using scb_t = std::function<void(const char *, std::size_t, bool)>;
+  //! Bytes read per system call in \c setscb mode.
+  static constexpr std::size_t stream_bufsize = 0x4000;
 
   template<typename T> msg_sock(pollset &ps, sock_t s, T &&rcb,
 				size_t maxmsglen = default_maxmsglen)
@@ -42,10 +53,44 @@ public:
     rcb_ = std::forward<T>(rcb);
     initcb();
   }
+  //! Receive each record fragment as soon as it arrives, rather than
+  //! buffering whole records for the \c rcb_t callback.  The \c bool
+  //! is true for the last fragment of a record.  At EOF or on error,
+  //! the callback receives \c nullptr (and \c true).  In this mode,
+  //! \c maxmsglen limits the size of each fragment, not each record.
+  template<typename T> void setfcb(T &&fcb) {
+    fcb_ = std::forward<T>(fcb);
+    initcb();
+  }
+  //! Receive record contents as a stream of byte ranges, exactly as
+  //! they are read from the socket, without assembling them into
+  //! messages (see xdr::xdr_stream_decoder).  The \c bool is true
+  //! when the range ends a record.  The bytes are only valid for the
+  //! duration of the call.  At EOF or on error, the callback receives
+  //! \c nullptr.  In this mode, \c maxmsglen still limits the size of
+  //! a record.  Set the callback before any data arrives.
+  template<typename T> void setscb(T &&scb) {
+    scb_ = std::forward<T>(scb);
+    initcb();
+  }
+  //! Send messages longer than \c n bytes as multiple fragments.
+  void set_fragsize(size_t n) {
+    assert(n > 0 && n <= max_fragsize);
+    fragsize_ = n;
+  }
 
   size_t wsize() const { return wsize_; }
   void putmsg(msg_ptr &b);
   void putmsg(msg_ptr &&b) { putmsg(b); }
+  //! Queue a scatter-gather message.  Its segments are passed to \c
+  //! writev as is, so anything they reference must stay valid until
+  //! the message has been written (see \c iovec_msg::hold).
+  void putmsg(iovec_msg &&m);
+  //! Queue a message that may also be queued on other sockets, as
+  //! when broadcasting one update to many peers.  Each socket writes
+  //! straight from the shared buffer, which is freed once the last of
+  //! them is done with it.
+  void putmsg(shared_msg_ptr m);
   //! Returns pointer to a \c bool that becomes \c true once the
   //! msg_sock has been deleted.
   std::shared_ptr<const bool> destroyed_ptr() const { return destroyed_; }
@@ -61,14 +106,39 @@ private:
   std::shared_ptr<bool> destroyed_{std::make_shared<bool>(false)};
 
   rcb_t rcb_;
+  fcb_t fcb_;
+  scb_t scb_;
   uint32_t nextlen_;
-  msg_ptr rdmsg_;
-  size_t rdpos_ {0};
-
-  std::deque<msg_ptr> wqueue_;
+  msg_ptr rdmsg_;		// Record (or fragment) being received
+  size_t rdpos_ {0};		// Bytes read of fragment body or length
+  size_t rdbase_ {0};		// Offset of current fragment in rdmsg_
+  size_t rdfrag_ {0};		// Length of current fragment
+  bool rdbody_ {false};		// Reading fragment body (not length)
+  bool rdlast_ {false};		// Current fragment ends the record
+  size_t fragsize_ {max_fragsize};
+  std::unique_ptr<std::uint32_t[]> rdbuf_; // For setscb mode
+  size_t rdskew_ {0};		// Bytes read so far, modulo 4
+
+  using wmsg_t = std::variant<msg_ptr, iovec_msg, shared_msg_ptr>;
+  std::deque<wmsg_t> wqueue_;
   size_t wsize_ {0};
   size_t wstart_ {0};
   bool wfail_ {false};
+  static constexpr size_t maxiov = 64;
+
+#if XDRPP_HAVE_IO_URING
+  // Write handed to the pollset (see pollset::async_writev), covering
+  // the front of wqueue_.  If the msg_sock is deleted first, the
+  // queue moves here to keep the data alive until the write is done.
+  struct wbatch {
+    iovec v[maxiov];
+    std::deque<wmsg_t> orphans;
+  };
+  std::shared_ptr<wbatch> wbatch_;
+  bool wbusy_ {false};
+  void output_async();
+  void output_done(long n);
+#endif // XDRPP_HAVE_IO_URING
 
   static constexpr bool eagain(int err) {
     return err == EAGAIN || err == EWOULDBLOCK || err == EINTR;
@@ -79,6 +149,14 @@ private:
   void init();
   void initcb();
   void input();
+  void stream_input();
+  void input_error();
+  bool start_fragment();
+  bool end_fragment();
+  static size_t wmsg_size(const wmsg_t &m);
+  static size_t wmsg_iov(const wmsg_t &m, size_t skip, iovec *v, size_t n);
+  size_t wqueue_iov(iovec *v) const;
+  void pushmsg(wmsg_t &&m, size_t size);
   void pop_wbytes(size_t n);
   void output(bool cbset);
 };
@@ -124,6 +202,7 @@ public:
   void send_call(msg_ptr &b, rcb_t cb);
   void send_call(msg_ptr &&b, rcb_t cb) { send_call(b, cb); }
   void send_reply(msg_ptr &&b) { ms_->putmsg(std::move(b)); }
+  void send_reply(iovec_msg &&m) { ms_->putmsg(std::move(m)); }
 };
 
 //! Functor wrapper around \c rpc_sock::send_reply.  Mostly useful
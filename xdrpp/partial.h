@@ -0,0 +1,203 @@
+// -*- C++ -*-
+
+/** \file partial.h Decoding selected parts of a message.  A router
+ * that only looks at one field of a large struct, or the discriminant
+ * of a union, should not have to unmarshal the rest.
+ * xdr::xdr_skip steps over a marshaled value using only its length
+ * prefixes, xdr::xdr_field_offsets uses it to find where each field of
+ * a struct begins, and xdr::xdr_lazy decodes fields of a message one
+ * at a time as they are requested.
+ */
+
+#ifndef _XDRPP_PARTIAL_H_HEADER_INCLUDED_
+#define _XDRPP_PARTIAL_H_HEADER_INCLUDED_ 1
+
+#include <array>
+#include <xdrpp/validate.h>
+
+namespace xdr {
+
+#if XDRPP_WORDS_BIGENDIAN
+using xdr_skip = xdr_generic_validate<marshal_noswap, false>;
+#else // !XDRPP_WORDS_BIGENDIAN
+//! Archive that skips over values in RFC4506 big-endian order,
+//! checking only what it must to find where they end.
+using xdr_skip = xdr_generic_validate<marshal_swap, false>;
+#endif // !XDRPP_WORDS_BIGENDIAN
+
+namespace detail {
+template<typename S> constexpr std::size_t
+field_count()
+{
+  if constexpr (has_field_info<S>::value)
+    return 1 + field_count<typename S::next_field>();
+  else
+    return 0;
+}
+
+template<typename S, std::size_t I> struct nth_field
+  : nth_field<typename S::next_field, I-1> {};
+template<typename S> struct nth_field<S, 0> {
+  using type = typename S::field_info;
+};
+
+template<typename S, typename FP> constexpr std::size_t
+field_index()
+{
+  static_assert(has_field_info<S>::value, "no such field");
+  if constexpr (std::is_same<typename S::field_info, FP>::value)
+    return 0;
+  else
+    return 1 + field_index<typename S::next_field, FP>();
+}
+
+template<typename MP> struct mem_ptr_traits;
+template<typename C, typename F> struct mem_ptr_traits<F C::*> {
+  using class_type = C;
+  using field_type = F;
+};
+//! The xdr::field_ptr type describing member pointer \c Ptr.
+template<auto Ptr> using field_ptr_of =
+  field_ptr<typename mem_ptr_traits<decltype(Ptr)>::class_type,
+	    typename mem_ptr_traits<decltype(Ptr)>::field_type, Ptr>;
+
+template<typename S, std::size_t N, std::size_t I = 0> void
+record_offsets(xdr_skip &s, const std::uint32_t *start,
+	       std::array<std::size_t, N> &out)
+{
+  out[I] = 4 * (s.p_ - start);
+  if constexpr (has_field_info<S>::value) {
+    s.template value<typename S::field_info::field_type>();
+    record_offsets<typename S::next_field, N, I+1>(s, start, out);
+  }
+}
+} // namespace detail
+
+//! Number of fields in struct \c T.
+template<typename T> constexpr std::size_t xdr_field_count =
+  detail::field_count<xdr_traits<T>>();
+
+//! Byte offsets, relative to \c start, at which each field of struct
+//! \c T begins when marshaled there.  The last element is the offset
+//! just past the struct.  Throws xdr::xdr_overflow and the like if
+//! the fields cannot be delimited, but does not otherwise check them.
+template<typename T> std::array<std::size_t, xdr_field_count<T> + 1>
+xdr_field_offsets(const void *start, const void *end)
+{
+  static_assert(xdr_traits<T>::is_struct, "xdr_field_offsets needs a struct");
+  std::array<std::size_t, xdr_field_count<T> + 1> out;
+  xdr_skip s(start, end);
+  detail::record_offsets<xdr_traits<T>>(s, s.p_, out);
+  return out;
+}
+template<typename T> std::array<std::size_t, xdr_field_count<T> + 1>
+xdr_field_offsets(const msg_ptr &m)
+{
+  return xdr_field_offsets<T>(m->data(), m->end());
+}
+
+//! A marshaled struct or union of type \c T whose parts are
+//! unmarshaled only when asked for.  Fields are named by member
+//! pointer, as in <tt>lazy.get<&T::field>()</tt>.  Locating a field
+//! skips over the ones before it (see xdr::xdr_skip), remembering
+//! their offsets, so the cost of each access is proportional to the
+//! data it touches or steps over.  Parts of the message never visited
+//! are never checked; use xdr::xdr_validate first if that matters.
+//! Views such as xdr::opaque_view unmarshaled from an \c xdr_lazy
+//! share ownership of the message.  Because of the cached offsets, an
+//! \c xdr_lazy must not be used from several threads at once.
+template<typename T> class xdr_lazy {
+  using traits = xdr_traits<T>;
+  static_assert(traits::is_struct || traits::is_union,
+		"xdr_lazy needs a struct or union");
+  template<typename> friend class xdr_lazy;
+  static constexpr std::size_t nfields =
+    detail::field_count<traits>();
+
+  shared_msg_ptr m_;
+  const char *base_;
+  std::size_t size_;
+  // Offsets of the first known_ fields
+  mutable std::array<std::size_t, nfields + 1> off_ {};
+  mutable std::size_t known_ {1};
+
+  xdr_lazy(shared_msg_ptr m, const char *base, std::size_t size)
+    : m_(std::move(m)), base_(base), size_(size) {}
+
+  xdr_get archive_at(std::size_t off) const {
+    return xdr_get(base_ + off, base_ + size_, m_);
+  }
+
+  template<std::size_t I> std::size_t offset_of() const {
+    if constexpr (I > 0) {
+      if (known_ <= I) {
+	std::size_t prev = offset_of<I-1>();
+	xdr_skip s(base_ + prev, base_ + size_);
+	s.template value<
+	  typename detail::nth_field<traits, I-1>::type::field_type>();
+	off_[I] = prev + 4 * (s.p_
+			      - reinterpret_cast<const std::uint32_t *>(
+				  base_ + prev));
+	known_ = I + 1;
+      }
+    }
+    return off_[I];
+  }
+
+  template<auto Ptr> static constexpr std::size_t index_of() {
+    return detail::field_index<traits, detail::field_ptr_of<Ptr>>();
+  }
+
+public:
+  //! Decode parts of \c m as a \c T.
+  explicit xdr_lazy(shared_msg_ptr m)
+    : m_(std::move(m)), base_(m_->data()), size_(m_->size()) {}
+
+  //! Byte offset of field \c Ptr within the marshaled struct.
+  template<auto Ptr> std::size_t offset() const {
+    return offset_of<index_of<Ptr>()>();
+  }
+
+  //! Unmarshal field \c Ptr into \c f.
+  template<auto Ptr> void get(
+    typename detail::mem_ptr_traits<decltype(Ptr)>::field_type &f) const {
+    xdr_get g(archive_at(offset<Ptr>()));
+    archive(g, f);
+  }
+  //! Unmarshal and return field \c Ptr.
+  template<auto Ptr> typename detail::mem_ptr_traits<decltype(Ptr)>::field_type
+  get() const {
+    typename detail::mem_ptr_traits<decltype(Ptr)>::field_type f;
+    get<Ptr>(f);
+    return f;
+  }
+
+  //! Lazy access to field \c Ptr, which must itself be a struct or
+  //! union.
+  template<auto Ptr> xdr_lazy<
+    typename detail::mem_ptr_traits<decltype(Ptr)>::field_type>
+  lazy() const {
+    std::size_t off = offset<Ptr>();
+    return {m_, base_ + off, size_ - off};
+  }
+
+  //! The discriminant of a union, without unmarshaling the arm.
+  auto discriminant() const {
+    static_assert(traits::is_union, "discriminant() needs a union");
+    std::decay_t<typename traits::discriminant_type> d;
+    xdr_get g(archive_at(0));
+    archive(g, d);
+    return d;
+  }
+
+  //! Unmarshal the whole value.  Unlike xdr::xdr_from_msg, this does
+  //! not require that it fill the rest of the message.
+  void decode(T &t) const {
+    xdr_get g(archive_at(0));
+    archive(g, t);
+  }
+};
+
+}
+
+#endif // !_XDRPP_PARTIAL_H_HEADER_INCLUDED_
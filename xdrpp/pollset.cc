@@ -1,6 +1,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cassert>
 #include <chrono>
 #include <cstring>
@@ -11,19 +12,253 @@
 #include <unistd.h>
 #include <xdrpp/pollset.h>
 
+#if XDRPP_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif // XDRPP_HAVE_IO_URING
+
 namespace xdr {
 
 std::mutex pollset_plus::signal_owners_lock;
 pollset_plus *pollset_plus::signal_owners[num_sig];
 volatile std::sig_atomic_t pollset_plus::signal_flags[num_sig];
 
+namespace detail {
+
+timer_wheel::timer_wheel(std::int64_t now)
+  : cur_(now)
+{
+  for (link &h : heads_)
+    h.next_ = h.prev_ = &h;
+}
+
+timer_wheel::node *
+timer_wheel::alloc()
+{
+  if (!free_) {
+    constexpr std::size_t chunk = 256;
+    node *c = chunks_.emplace_back(new node[chunk]).get();
+    for (std::size_t i = chunk; i-- > 0;) {
+      c[i].next_ = free_;
+      free_ = &c[i];
+    }
+  }
+  node *n = free_;
+  free_ = static_cast<node *>(n->next_);
+  ++size_;
+  return n;
+}
+
+void
+timer_wheel::release(node *n)
+{
+  // Destroy the callback only once the wheel is consistent, in case
+  // its destructor cancels other timeouts.
+  cb_t cb;
+  cb.swap(n->cb_);
+  n->next_ = free_;
+  free_ = n;
+  --size_;
+}
+
+void
+timer_wheel::place(node *n)
+{
+  std::uint16_t list = due_list;
+  if (n->when_ >= cur_) {
+    constexpr int maxbits = nlevels * slot_bits;
+    std::int64_t when = n->when_;
+    if (std::uint64_t(when ^ cur_) >> maxbits)
+      when = cur_ | ((std::int64_t(1) << maxbits) - 1);
+    std::uint64_t diff = when ^ cur_;
+    int level = diff ? (std::bit_width(diff) - 1) / slot_bits : 0;
+    int slot = when >> (level * slot_bits) & (nslots - 1);
+    occupied_[level] |= std::uint64_t(1) << slot;
+    list = level * nslots + slot;
+  }
+  link &h = heads_[list];
+  n->list_ = list;
+  n->next_ = &h;
+  n->prev_ = h.prev_;
+  h.prev_->next_ = n;
+  h.prev_ = n;
+}
+
+void
+timer_wheel::unlink(node *n)
+{
+  n->prev_->next_ = n->next_;
+  n->next_->prev_ = n->prev_;
+  if (n->list_ < due_list) {
+    link &h = heads_[n->list_];
+    if (h.next_ == &h)
+      occupied_[n->list_ / nslots] &= ~(std::uint64_t(1) << n->list_ % nslots);
+  }
+}
+
+// Move every node from list from to the empty list to.  The nodes
+// keep their list_, which is harmless: unlink only uses it to clear
+// the occupied_ bit of a slot that is empty.
+void
+timer_wheel::take(link &from, link &to)
+{
+  if (from.next_ == &from) {
+    to.next_ = to.prev_ = &to;
+    return;
+  }
+  to.next_ = from.next_;
+  to.prev_ = from.prev_;
+  to.next_->prev_ = to.prev_->next_ = &to;
+  from.next_ = from.prev_ = &from;
+}
+
+// Set the current time to t, and refile timeouts in the slots that
+// reaches at higher levels.  Callers must not skip over non-empty
+// slots.
+void
+timer_wheel::advance(std::int64_t t)
+{
+  cur_ = t;
+  if (t & (nslots - 1))
+    return;
+  int top = 1;
+  while (top + 1 < nlevels
+	 && !(t & ((std::int64_t(1) << (top + 1) * slot_bits) - 1)))
+    ++top;
+  for (int level = top; level > 0; --level) {
+    int slot = t >> (level * slot_bits) & (nslots - 1);
+    if (occupied_[level] >> slot & 1) {
+      // Nodes always move to lower levels, never back to this slot
+      link &h = heads_[level * nslots + slot];
+      link *l = h.next_;
+      h.next_ = h.prev_ = &h;
+      occupied_[level] &= ~(std::uint64_t(1) << slot);
+      while (l != &h) {
+	node *n = static_cast<node *>(l);
+	l = l->next_;
+	place(n);
+      }
+    }
+  }
+}
+
+void
+timer_wheel::run(link &batch)
+{
+  // If a callback throws, free it and leave the rest of the batch
+  // due, as though the callback had returned.
+  struct cleanup {
+    timer_wheel &w_;
+    link &batch_;
+    node *running_ {nullptr};
+    ~cleanup() {
+      if (running_ && running_->list_ >= running_list)
+	w_.release(running_);
+      while (batch_.next_ != &batch_) {
+	node *n = static_cast<node *>(batch_.next_);
+	w_.unlink(n);
+	w_.place(n);
+      }
+    }
+  } c {*this, batch};
+
+  while (batch.next_ != &batch) {
+    node *n = static_cast<node *>(batch.next_);
+    unlink(n);
+    if (n->when_ >= cur_) {
+      place(n);			// Was filed early; see nlevels
+      continue;
+    }
+    n->list_ = running_list;
+    c.running_ = n;
+    n->cb_();
+    c.running_ = nullptr;
+    if (n->list_ >= running_list)
+      release(n);
+  }
+}
+
+timer_wheel::node *
+timer_wheel::add(std::int64_t when, cb_t &&cb)
+{
+  node *n = alloc();
+  n->when_ = when;
+  n->cb_ = std::move(cb);
+  place(n);
+  return n;
+}
+
+void
+timer_wheel::cancel(node *n)
+{
+  if (n->list_ == running_list)
+    n->list_ = cancelled_list;
+  else if (n->list_ != cancelled_list) {
+    unlink(n);
+    release(n);
+  }
+}
+
+void
+timer_wheel::reschedule(node *n, std::int64_t when)
+{
+  if (n->list_ < running_list)
+    unlink(n);
+  n->when_ = when;
+  place(n);
+}
+
+std::int64_t
+timer_wheel::next_slot_time() const
+{
+  // A level's slots at or before the current time's digit are empty,
+  // except at level 0, where the current millisecond may be pending.
+  for (int level = 0; level < nlevels; level++)
+    if (std::uint64_t bits = occupied_[level]) {
+      int shift = level * slot_bits;
+      return (cur_ >> shift >> slot_bits << slot_bits
+	      | std::countr_zero(bits)) << shift;
+    }
+  return std::numeric_limits<std::int64_t>::max();
+}
+
+std::int64_t
+timer_wheel::next_time() const
+{
+  if (heads_[due_list].next_ != &heads_[due_list])
+    return std::numeric_limits<std::int64_t>::min();
+  return next_slot_time();
+}
+
+void
+timer_wheel::expire(std::int64_t now)
+{
+  link batch;
+  if (heads_[due_list].next_ != &heads_[due_list]) {
+    take(heads_[due_list], batch);
+    run(batch);
+  }
+  while (cur_ <= now) {
+    if (std::int64_t next = next_slot_time(); next > cur_) {
+      advance(std::min(next, now + 1));
+      continue;
+    }
+    take(heads_[cur_ & (nslots - 1)], batch);
+    occupied_[0] &= ~(std::uint64_t(1) << (cur_ & (nslots - 1)));
+    advance(cur_ + 1);
+    run(batch);
+  }
+}
+
+} // namespace detail
+
 pollset::Timeout
 pollset::timeout_null()
 {
-  static decltype(pollset::time_cbs_) dummy_time_cbs_;
-  return Timeout{dummy_time_cbs_.end()};
+  return Timeout{};
 }
-const pollset::Timeout pollset::Timeout::null_(pollset::timeout_null());
+const pollset::Timeout pollset::Timeout::null_;
 
 void
 pollset_plus::signal_handler(int sig)
@@ -43,7 +278,197 @@ pollset_plus::signal_handler(int sig)
   signal_flags[sig] = 2;
 }
 
-pollset_plus::pollset_plus()
+#if XDRPP_HAVE_IO_URING
+// Minimal io_uring setup, without liburing.  Requests are written to
+// the submission ring as they are made and passed to the kernel in
+// one io_uring_enter call, which also waits for completions.
+struct pollset::uring {
+  static constexpr unsigned entries = 4096;
+
+  int fd_ {-1};
+  void *sq_ {MAP_FAILED};
+  std::size_t sq_len_ {0};
+  void *cq_ {MAP_FAILED};
+  std::size_t cq_len_ {0};
+  io_uring_sqe *sqes_ {static_cast<io_uring_sqe *>(MAP_FAILED)};
+  std::size_t sqes_len_ {0};
+
+  unsigned *sq_head_, *sq_tail_, *sq_array_, sq_mask_, sq_entries_;
+  unsigned *cq_head_, *cq_tail_, cq_mask_;
+  io_uring_cqe *cqes_;
+  unsigned to_submit_ {0};
+
+  uring();
+  ~uring() { release(); }
+  uring(const uring &) = delete;
+  uring &operator=(const uring &) = delete;
+
+  template<typename T> static T *at(void *base, unsigned off) {
+    return reinterpret_cast<T *>(static_cast<char *>(base) + off);
+  }
+  static unsigned load_acquire(unsigned *p) {
+    return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+  }
+  static void store_release(unsigned *p, unsigned v) {
+    std::atomic_ref<unsigned>(*p).store(v, std::memory_order_release);
+  }
+
+  void release();
+  int enter(unsigned min_complete, int ms);
+  void submit();
+  io_uring_sqe *get_sqe();
+};
+
+pollset::uring::uring()
+{
+  io_uring_params p {};
+  fd_ = syscall(__NR_io_uring_setup, entries, &p);
+  if (fd_ == -1)
+    throw std::system_error(errno, std::system_category(), "io_uring_setup");
+  if (!(p.features & IORING_FEAT_NODROP)
+      || !(p.features & IORING_FEAT_EXT_ARG)) {
+    release();
+    throw std::system_error(ENOSYS, std::system_category(),
+			    "io_uring too old");
+  }
+
+  sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+  sq_ = mmap(nullptr, sq_len_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+	     fd_, IORING_OFF_SQ_RING);
+  if (sq_ != MAP_FAILED && (p.features & IORING_FEAT_SINGLE_MMAP))
+    cq_ = sq_;
+  else if (sq_ != MAP_FAILED)
+    cq_ = mmap(nullptr, cq_len_, PROT_READ|PROT_WRITE,
+	       MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+  sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+  if (cq_ != MAP_FAILED)
+    sqes_ = static_cast<io_uring_sqe *>(
+      mmap(nullptr, sqes_len_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+	   fd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED) {
+    int err = errno;
+    release();
+    throw std::system_error(err, std::system_category(), "mmap io_uring");
+  }
+
+  sq_head_ = at<unsigned>(sq_, p.sq_off.head);
+  sq_tail_ = at<unsigned>(sq_, p.sq_off.tail);
+  sq_array_ = at<unsigned>(sq_, p.sq_off.array);
+  sq_mask_ = *at<unsigned>(sq_, p.sq_off.ring_mask);
+  sq_entries_ = p.sq_entries;
+  cq_head_ = at<unsigned>(cq_, p.cq_off.head);
+  cq_tail_ = at<unsigned>(cq_, p.cq_off.tail);
+  cq_mask_ = *at<unsigned>(cq_, p.cq_off.ring_mask);
+  cqes_ = at<io_uring_cqe>(cq_, p.cq_off.cqes);
+}
+
+void
+pollset::uring::release()
+{
+  if (sqes_ != MAP_FAILED)
+    munmap(sqes_, sqes_len_);
+  if (cq_ != MAP_FAILED && cq_ != sq_)
+    munmap(cq_, cq_len_);
+  if (sq_ != MAP_FAILED)
+    munmap(sq_, sq_len_);
+  if (fd_ != -1)
+    close(fd_);
+}
+
+// Submit queued requests and wait up to ms milliseconds (-1 for
+// forever) for at least min_complete completions.
+int
+pollset::uring::enter(unsigned min_complete, int ms)
+{
+  io_uring_getevents_arg arg {};
+  arg.sigmask_sz = _NSIG / 8;
+  timespec ts;
+  if (min_complete && ms >= 0) {
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    arg.ts = reinterpret_cast<std::uintptr_t>(&ts);
+  }
+  int r = syscall(__NR_io_uring_enter, fd_, to_submit_, min_complete,
+		  IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		  &arg, sizeof(arg));
+  if (r > 0)
+    to_submit_ -= std::min<unsigned>(r, to_submit_);
+  return r;
+}
+
+void
+pollset::uring::submit()
+{
+  if (!to_submit_)
+    return;
+  int r = syscall(__NR_io_uring_enter, fd_, to_submit_, 0, 0, nullptr, 0);
+  if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+    std::cerr << "io_uring_enter: " << sock_errmsg() << std::endl;
+    std::terminate();
+  }
+  if (r > 0)
+    to_submit_ -= std::min<unsigned>(r, to_submit_);
+}
+
+io_uring_sqe *
+pollset::uring::get_sqe()
+{
+  unsigned tail = *sq_tail_;
+  if (tail - load_acquire(sq_head_) == sq_entries_) {
+    submit();
+    if (tail - load_acquire(sq_head_) == sq_entries_) {
+      std::cerr << "io_uring submission queue full" << std::endl;
+      std::terminate();
+    }
+  }
+  unsigned idx = tail & sq_mask_;
+  io_uring_sqe *sqe = &sqes_[idx];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sq_array_[idx] = idx;
+  store_release(sq_tail_, tail + 1);
+  ++to_submit_;
+  return sqe;
+}
+#endif // XDRPP_HAVE_IO_URING
+
+pollset::pollset(backend b)
+  : backend_(b)
+{
+#if XDRPP_HAVE_IO_URING
+  if (backend_ == backend::Uring) {
+    try {
+      uring_ = std::make_unique<uring>();
+    }
+    catch (const std::system_error &) {
+      backend_ = backend::Epoll;
+    }
+  }
+#else // !XDRPP_HAVE_IO_URING
+  if (backend_ == backend::Uring)
+    backend_ = backend::Epoll;
+#endif // !XDRPP_HAVE_IO_URING
+#if XDRPP_HAVE_EPOLL
+  if (backend_ == backend::Epoll
+      && (epfd_ = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    throw std::system_error(errno, std::system_category(), "epoll_create1");
+#else // !XDRPP_HAVE_EPOLL
+  backend_ = backend::Poll;
+#endif // !XDRPP_HAVE_EPOLL
+}
+
+pollset::~pollset()
+{
+#if XDRPP_HAVE_EPOLL
+  if (epfd_ != -1)
+    close(epfd_);
+#endif // XDRPP_HAVE_EPOLL
+}
+
+pollset_plus::pollset_plus(backend b)
+  : pollset(b)
 {
   create_selfpipe(selfpipe_);
   set_close_on_exec(selfpipe_[0]);
@@ -131,39 +556,44 @@ pollset_plus::inject_cb_vec(std::vector<cb_t>::iterator b,
 pollset::cb_t &
 pollset::fd_cb_helper(sock_t s, op_t op)
 {
-  fd_state &fs = state_[s];
-  pollfd *pfdp;
-  if (fs.idx < 0) {
-    fs.idx = pollfds_.size();
-    pollfds_.resize(fs.idx + 1);
-    pfdp = &pollfds_.back();
-    pfdp->fd = s.fd_;		// XXX
-  }
-  else {
-    pfdp = &pollfds_.at(fs.idx);
-    assert (pfdp->fd == s.fd_);	// XXX
-  }
-  if (op & kReadFlag) {
-    if (op & kWriteFlag) {
-      std::cerr << "Illegal call to pollset::fd_cb with ReadWrite"
-		<< std::endl;
-      std::terminate();
-    }
-    fs.roneshot = op & kOnceFlag;
-    pfdp->events |= POLLIN;
-    return fs.rcb;
-  }
-  else if (op & kWriteFlag) {
-    fs.woneshot = op & kOnceFlag;
-    pfdp->events |= POLLOUT;
-    return fs.wcb;
+  if ((op & kReadFlag) && (op & kWriteFlag)) {
+    std::cerr << "Illegal call to pollset::fd_cb with ReadWrite"
+	      << std::endl;
+    std::terminate();
   }
-  else {
+  if (!(op & (kReadFlag | kWriteFlag))) {
     std::cerr << "Illegal call to pollset::fd_cb with"
                  " neither Read nor Write"
 	      << std::endl;
     std::terminate();
   }
+
+  fd_state &fs = state_[s];
+  if (backend_ == backend::Poll) {
+    pollfd *pfdp;
+    if (fs.idx < 0) {
+      fs.idx = pollfds_.size();
+      pollfds_.resize(fs.idx + 1);
+      pfdp = &pollfds_.back();
+      pfdp->fd = s.fd_;		// XXX
+    }
+    else {
+      pfdp = &pollfds_.at(fs.idx);
+      assert (pfdp->fd == s.fd_);	// XXX
+    }
+    pfdp->events |= op & kReadFlag ? POLLIN : POLLOUT;
+  }
+#if XDRPP_HAVE_EPOLL
+  else
+    set_ops(s, fs, fs.ops | (op & ReadWrite));
+#endif // XDRPP_HAVE_EPOLL
+
+  if (op & kReadFlag) {
+    fs.roneshot = op & kOnceFlag;
+    return fs.rcb;
+  }
+  fs.woneshot = op & kOnceFlag;
+  return fs.wcb;
 }
 
 void
@@ -172,22 +602,33 @@ pollset::fd_cb(sock_t s, op_t op, std::nullptr_t)
   auto fi = state_.find(s);
   if (fi == state_.end())
     return;
-  pollfd &pfd = pollfds_.at(fi->second.idx);
-  
-  if (op & kReadFlag) {
-    pfd.events &= ~POLLIN;
-    fi->second.rcb = nullptr;
-  }
-  if (op & kWriteFlag) {
-    pfd.events &= ~POLLOUT;
-    fi->second.wcb = nullptr;
+  fd_state &fs = fi->second;
+
+  if (op & kReadFlag)
+    fs.rcb = nullptr;
+  if (op & kWriteFlag)
+    fs.wcb = nullptr;
+  if (backend_ == backend::Poll) {
+    pollfd &pfd = pollfds_.at(fs.idx);
+    if (op & kReadFlag)
+      pfd.events &= ~POLLIN;
+    if (op & kWriteFlag)
+      pfd.events &= ~POLLOUT;
   }
+#if XDRPP_HAVE_EPOLL
+  else
+    set_ops(s, fs, fs.ops & ~(op & ReadWrite));
+#endif // XDRPP_HAVE_EPOLL
 }
 
 std::size_t
 pollset::num_cbs() const
 {
-  return pollfds_.size() + time_cbs_.size();
+  std::size_t n = state_.size() + time_cbs_.size();
+#if XDRPP_HAVE_IO_URING
+  n += io_cbs_.size();
+#endif // XDRPP_HAVE_IO_URING
+  return n;
 }
 
 bool
@@ -199,13 +640,13 @@ pollset_plus::pending() const
 int
 pollset::next_timeout(int ms)
 {
-  auto next = time_cbs_.begin();
-  if (next == time_cbs_.end())
+  int64_t next = time_cbs_.next_time();
+  if (next == std::numeric_limits<int64_t>::max())
     return ms;
   int64_t now = now_ms();
-  if (now >= next->first)
+  if (now >= next)
     return 0;
-  int64_t wait = next->first - now;
+  int64_t wait = next - now;
   if (wait > std::numeric_limits<int>::max())
     wait = std::numeric_limits<int>::max();
   if (ms >= 0 && ms <= wait)
@@ -216,7 +657,27 @@ pollset::next_timeout(int ms)
 void
 pollset::poll(int timeout)
 {
-  int r = ::poll(pollfds_.data(), pollfds_.size(), next_timeout(timeout));
+#if XDRPP_HAVE_IO_URING
+  if (backend_ == backend::Uring)
+    uring_fds(next_timeout(timeout));
+  else
+#endif // XDRPP_HAVE_IO_URING
+#if XDRPP_HAVE_EPOLL
+  if (backend_ == backend::Epoll)
+    epoll_fds(next_timeout(timeout));
+  else
+#endif // XDRPP_HAVE_EPOLL
+    poll_fds(next_timeout(timeout));
+
+  run_timeouts();
+  run_subtype_handlers();
+  consolidate();
+}
+
+void
+pollset::poll_fds(int ms)
+{
+  int r = ::poll(pollfds_.data(), pollfds_.size(), ms);
   if (r < 0) {
     if (errno == EINTR)
       return;
@@ -252,28 +713,228 @@ pollset::poll(int timeout)
 	fi.wcb();
     }
   }
+}
 
-  run_timeouts();
-  run_subtype_handlers();
-  consolidate();
+#if XDRPP_HAVE_EPOLL
+// Change the flags registered with the kernel for s.
+void
+pollset::set_ops(sock_t s, fd_state &fs, int ops)
+{
+#if XDRPP_HAVE_IO_URING
+  if (backend_ == backend::Uring)
+    uring_update(s, fs, ops);
+  else
+#endif // XDRPP_HAVE_IO_URING
+    epoll_update(s, fs, ops);
 }
 
+// Run the callbacks for a descriptor the kernel reported ready.
+// Entries in state_ are only erased by consolidate, so fs remains
+// valid even if callbacks add or remove descriptors.
 void
-pollset::run_timeouts()
+pollset::dispatch(sock_t s, fd_state &fs, bool readable, bool writable)
+{
+  if (readable && fs.rcb) {
+    if (fs.roneshot) {
+      cb_t cb {std::move(fs.rcb)};
+      fs.rcb = nullptr;
+      set_ops(s, fs, fs.ops & ~kReadFlag);
+      cb();
+    }
+    else
+      fs.rcb();
+  }
+  if (writable && fs.wcb) {
+    if (fs.woneshot) {
+      cb_t cb {std::move(fs.wcb)};
+      fs.wcb = nullptr;
+      set_ops(s, fs, fs.ops & ~kWriteFlag);
+      cb();
+    }
+    else
+      fs.wcb();
+  }
+}
+
+void
+pollset::epoll_update(sock_t s, fd_state &fs, int ops)
 {
-  auto i = time_cbs_.begin();
-  if (i != time_cbs_.end()) {
-    int64_t now = now_ms();
-    while (i != time_cbs_.end() && now >= i->first) {
-      struct cleanup {
-	cb_t cb_;
-	~cleanup() { cb_(); }
-      } c {[&]() { time_cbs_.erase(i++); }};
-      i->second();
+  if (ops == fs.ops)
+    return;
+  if (fs.always_ready) {
+    fs.ops = ops;
+    if (!ops) {
+      fs.always_ready = false;
+      ready_.erase(std::find(ready_.begin(), ready_.end(), s));
+      idle_.push_back(s);
+    }
+    return;
+  }
+  epoll_event ev {};
+  ev.events = (ops & kReadFlag ? std::uint32_t(EPOLLIN) : 0)
+    | (ops & kWriteFlag ? std::uint32_t(EPOLLOUT) : 0);
+  ev.data.fd = s.fd_;
+  int ctl = !ops ? EPOLL_CTL_DEL : fs.ops ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  int r = epoll_ctl(epfd_, ctl, s.fd_, &ev);
+  // Closing a descriptor removes it from the epoll set, so one closed
+  // (and perhaps reused) before its callbacks were cleared is gone.
+  if (r == -1 && ctl == EPOLL_CTL_MOD && errno == ENOENT)
+    r = epoll_ctl(epfd_, EPOLL_CTL_ADD, s.fd_, &ev);
+  // epoll refuses regular files and directories, which poll always
+  // reports ready, so behave the same way for them.
+  if (r == -1 && ops && errno == EPERM) {
+    fs.always_ready = true;
+    fs.ops = ops;
+    ready_.push_back(s);
+    return;
+  }
+  if (r == -1
+      && !(ctl == EPOLL_CTL_DEL && (errno == EBADF || errno == ENOENT))) {
+    std::cerr << "epoll_ctl: " << sock_errmsg() << std::endl;
+    std::terminate();
+  }
+  fs.ops = ops;
+  if (!ops)
+    idle_.push_back(s);
+}
+
+void
+pollset::epoll_fds(int ms)
+{
+  epoll_event evs[max_epoll_events];
+  if (!ready_.empty())
+    ms = 0;
+  int r = epoll_wait(epfd_, evs, max_epoll_events, ms);
+  if (r < 0) {
+    if (errno == EINTR)
+      return;
+    std::cerr << "epoll_wait: " << sock_errmsg() << std::endl;
+    std::terminate();
+  }
+  for (int i = 0; i < r; i++) {
+    sock_t s {evs[i].data.fd};
+    auto fi = state_.find(s);
+    if (fi == state_.end())
+      continue;
+    std::uint32_t events = evs[i].events;
+    dispatch(s, fi->second, events & (EPOLLIN|EPOLLHUP|EPOLLERR),
+	     events & (EPOLLOUT|EPOLLHUP|EPOLLERR));
+  }
+  if (ready_.empty())
+    return;
+  // Callbacks may add or remove entries, so iterate over a copy.
+  std::vector<sock_t> ready {ready_};
+  for (sock_t s : ready) {
+    auto fi = state_.find(s);
+    if (fi != state_.end() && fi->second.always_ready)
+      dispatch(s, fi->second, true, true);
+  }
+}
+#endif // XDRPP_HAVE_EPOLL
+
+#if XDRPP_HAVE_IO_URING
+// io_uring polls are one-shot, so each is re-armed after it fires.
+// Each request's user_data identifies it: 0 for requests whose
+// completions are ignored, the descriptor plus a sequence number
+// (below bit 63) for polls, and bit 63 plus a sequence number for
+// asynchronous I/O.
+void
+pollset::uring_update(sock_t s, fd_state &fs, int ops)
+{
+  if (ops == fs.ops && (fs.ud || !ops))
+    return;
+  if (fs.ud) {
+    io_uring_sqe *sqe = uring_->get_sqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = fs.ud;
+    fs.ud = 0;
+  }
+  fs.ops = ops;
+  if (!ops) {
+    idle_.push_back(s);
+    return;
+  }
+  fs.ud = (++uring_seq_ & 0x7fffffff) << 32 | std::uint32_t(s.fd_);
+  io_uring_sqe *sqe = uring_->get_sqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = s.fd_;
+  sqe->poll_events = (ops & kReadFlag ? POLLIN : 0)
+    | (ops & kWriteFlag ? POLLOUT : 0);
+  sqe->user_data = fs.ud;
+}
+
+void
+pollset::uring_fds(int ms)
+{
+  uring &u = *uring_;
+  if (u.enter(ms ? 1 : 0, ms) == -1
+      && errno != EINTR && errno != ETIME && errno != EAGAIN
+      && errno != EBUSY) {
+    std::cerr << "io_uring_enter: " << sock_errmsg() << std::endl;
+    std::terminate();
+  }
+
+  unsigned head = *u.cq_head_;
+  const unsigned tail = uring::load_acquire(u.cq_tail_);
+  for (; head != tail; ++head) {
+    const io_uring_cqe c = u.cqes_[head & u.cq_mask_];
+    uring::store_release(u.cq_head_, head + 1);
+    if (!c.user_data)
+      continue;
+
+    if (c.user_data >> 63) {
+      auto ii = io_cbs_.find(c.user_data);
+      assert(ii != io_cbs_.end());
+      io_cb_t cb {std::move(ii->second)};
+      io_cbs_.erase(ii);
+      cb(c.res);
+      continue;
     }
+
+    sock_t s {int(std::uint32_t(c.user_data))};
+    auto fi = state_.find(s);
+    if (fi == state_.end() || fi->second.ud != c.user_data)
+      continue;		// Removed or replaced since it was armed
+    fd_state &fs = fi->second;
+    fs.ud = 0;
+    int events = c.res < 0 ? POLLERR : c.res;
+    dispatch(s, fs, events & (POLLIN|POLLHUP|POLLERR),
+	     events & (POLLOUT|POLLHUP|POLLERR));
+    if (!fs.ud)
+      uring_update(s, fs, fs.ops);
   }
 }
 
+void
+pollset::async_writev(sock_t s, const iovec *iov, int iovcnt, io_cb_t cb)
+{
+  assert(backend_ == backend::Uring);
+  std::uint64_t ud = std::uint64_t(1) << 63 | ++uring_seq_;
+  io_cbs_.emplace(ud, std::move(cb));
+  io_uring_sqe *sqe = uring_->get_sqe();
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = s.fd_;
+  sqe->addr = reinterpret_cast<std::uintptr_t>(iov);
+  sqe->len = iovcnt;
+  sqe->user_data = ud;
+}
+
+void
+pollset::submit_io()
+{
+  if (uring_)
+    uring_->submit();
+}
+#endif // XDRPP_HAVE_IO_URING
+
+void
+pollset::run_timeouts()
+{
+  if (time_cbs_.size())
+    time_cbs_.expire(now_ms());
+}
+
 void
 pollset_plus::run_subtype_handlers()
 {
@@ -311,6 +972,18 @@ pollset_plus::run_subtype_handlers()
 void
 pollset::consolidate()
 {
+#if XDRPP_HAVE_EPOLL
+  if (backend_ != backend::Poll) {
+    for (sock_t s : idle_) {
+      auto fi = state_.find(s);
+      if (fi != state_.end() && !fi->second.ops)
+	state_.erase(fi);
+    }
+    idle_.clear();
+    return;
+  }
+#endif // XDRPP_HAVE_EPOLL
+
   while (!pollfds_.empty() && !pollfds_.back().events) {
     auto fi = state_.find(sock_t(pollfds_.back().fd)); // XXX
     if (fi != state_.end())
@@ -417,8 +1090,7 @@ void
 pollset::timeout_cancel(Timeout &t)
 {
   if (t) {
-    assert(time_cbs_.find(t.i_->first) != time_cbs_.end());
-    time_cbs_.erase(t.i_);
+    time_cbs_.cancel(t.n_);
     t = timeout_null();
   }
 }
@@ -426,9 +1098,7 @@ pollset::timeout_cancel(Timeout &t)
 void
 pollset::timeout_reschedule_at(Timeout &t, std::int64_t ms)
 {
-  auto i = t.i_;
-  t.i_ = time_cbs_.emplace(ms, std::move(i->second));
-  time_cbs_.erase(i);
+  time_cbs_.reschedule(t.n_, ms);
 }
 
 }
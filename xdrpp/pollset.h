@@ -14,11 +14,104 @@
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
+#include <optional>
 #include <poll.h>
 #include <xdrpp/socket.h>
+#include <xdrpp/thread_pool.h>
+
+#if !defined(XDRPP_HAVE_EPOLL) && defined(__linux__)
+#define XDRPP_HAVE_EPOLL 1
+#endif // !XDRPP_HAVE_EPOLL && __linux__
+#if XDRPP_HAVE_EPOLL
+#include <sys/epoll.h>
+#endif // XDRPP_HAVE_EPOLL
+#if !defined(XDRPP_HAVE_IO_URING) && XDRPP_HAVE_EPOLL
+#if __has_include(<linux/io_uring.h>)
+#define XDRPP_HAVE_IO_URING 1
+#endif // __has_include(<linux/io_uring.h>)
+#endif // !XDRPP_HAVE_IO_URING && XDRPP_HAVE_EPOLL
+#if XDRPP_HAVE_IO_URING
+#include <sys/uio.h>
+#endif // XDRPP_HAVE_IO_URING
 
 namespace xdr {
 
+namespace detail {
+//! Hierarchical timing wheel holding a pollset's timeouts.  Level 0
+//! has a slot for each of the next 64 milliseconds, and each higher
+//! level has 64 slots 64 times as coarse as the level below.  A
+//! timeout is filed at the level of the highest 6-bit digit in which
+//! its time differs from the wheel's current time, and drops to a
+//! lower level when the wheel reaches its slot, so adding, cancelling,
+//! and rescheduling timeouts all take constant time.  Nodes are
+//! recycled through a free list rather than returned to the heap.
+//! Timeouts due in the same millisecond, or already overdue when
+//! scheduled, run in no particular order.
+class timer_wheel {
+public:
+  using cb_t = std::function<void()>;
+  static constexpr int slot_bits = 6;
+  static constexpr int nslots = 1 << slot_bits;
+  //! Enough levels for 2^60 milliseconds.  Later timeouts are filed
+  //! as if due then, and filed again when the wheel gets there.
+  static constexpr int nlevels = 10;
+
+  struct link {
+    link *next_;
+    link *prev_;
+  };
+  struct alignas(64) node : link {
+    std::int64_t when_;
+    std::uint16_t list_;	// Index into heads_, or one of the below
+    cb_t cb_;
+  };
+
+private:
+  static constexpr std::uint16_t due_list = nlevels * nslots;
+  static constexpr std::uint16_t running_list = due_list + 1;
+  static constexpr std::uint16_t cancelled_list = due_list + 2;
+
+  link heads_[due_list + 1];	// Circular lists: slots, then overdue
+  std::uint64_t occupied_[nlevels] {}; // Bitmaps of non-empty slots
+  std::int64_t cur_;		// Earliest millisecond not yet expired
+  std::size_t size_ {0};
+  node *free_ {nullptr};
+  std::vector<std::unique_ptr<node[]>> chunks_;
+
+  node *alloc();
+  void release(node *n);
+  void place(node *n);
+  void unlink(node *n);
+  void take(link &from, link &to);
+  void advance(std::int64_t t);
+  void run(link &batch);
+  std::int64_t next_slot_time() const;
+
+public:
+  explicit timer_wheel(std::int64_t now);
+  timer_wheel(const timer_wheel &) = delete;
+  timer_wheel &operator=(const timer_wheel &) = delete;
+
+  //! Number of pending timeouts, including any currently running.
+  std::size_t size() const { return size_; }
+  node *add(std::int64_t when, cb_t &&cb);
+  //! May be called on a running timeout, which is then freed when its
+  //! callback returns.
+  void cancel(node *n);
+  //! May be called on a running timeout to make it run again.
+  void reschedule(node *n, std::int64_t when);
+  //! No timeout is due before the returned time, which is the minimum
+  //! \c int64_t if some are already overdue and the maximum if none
+  //! are pending.  This may be earlier than the first timeout, since
+  //! timeouts in coarse slots are only sorted when the wheel reaches
+  //! their slots.
+  std::int64_t next_time() const;
+  //! Run all timeouts due at or before \c now.  Timeouts scheduled
+  //! by callbacks for \c now or earlier run on the next call.
+  void expire(std::int64_t now);
+};
+} // namespace detail
+
 //! Structure to poll for a set of file descriptors and timeouts.
 class pollset {
 protected:
@@ -42,7 +135,26 @@ public:
     WriteOnce = kWriteFlag | kOnceFlag
   };
 
+  //! Mechanism used to wait on file descriptors.  \c Poll passes
+  //! every registered descriptor to the kernel and scans them all on
+  //! each call to PollSet::poll.  \c Epoll (Linux only) keeps the set
+  //! in the kernel, so each call costs time proportional to the
+  //! number of ready descriptors, which matters with many idle ones.
+  //! \c Uring (Linux 5.11 or later) waits with io_uring instead:
+  //! changes in interest are queued and submitted in a batch with the
+  //! next wait, and xdr::msg_sock hands its writes to the pollset (see
+  //! \c async_writev) so that they are batched the same way.
+  enum class backend { Poll, Epoll, Uring };
+#if XDRPP_HAVE_EPOLL
+  static constexpr backend default_backend = backend::Epoll;
+#else // !XDRPP_HAVE_EPOLL
+  static constexpr backend default_backend = backend::Poll;
+#endif // !XDRPP_HAVE_EPOLL
+
   using cb_t = std::function<void()>;
+  //! Completion callback for asynchronous I/O, which receives the
+  //! result of the system call or the negated \c errno value.
+  using io_cb_t = std::function<void(long)>;
 
 private:
   // File descriptor callback information
@@ -50,19 +162,49 @@ private:
     cb_t rcb;
     cb_t wcb;
     int idx {-1};		// Index in pollfds_
+    int ops {0};		// Flags registered with epoll or io_uring
+    std::uint64_t ud {0};	// io_uring poll request, or 0 if none
+    bool always_ready {false};	// Rejected by epoll (e.g., regular file)
     bool roneshot;
     bool woneshot;
     ~fd_state();		// Sanity check no active callbacks
   };
 
+  backend backend_;
+
   // File descriptor callback state
   std::vector<pollfd> pollfds_;
   std::unordered_map<sock_t, fd_state> state_;
 
+#if XDRPP_HAVE_EPOLL
+  static constexpr int max_epoll_events = 256;
+  int epfd_ {-1};
+  // Descriptors whose last callback was removed, to erase from state_
+  std::vector<sock_t> idle_;
+  // Descriptors epoll cannot wait on, which are treated as always ready
+  std::vector<sock_t> ready_;
+
+  void set_ops(sock_t s, fd_state &fs, int ops);
+  void dispatch(sock_t s, fd_state &fs, bool readable, bool writable);
+  void epoll_update(sock_t s, fd_state &fs, int ops);
+  void epoll_fds(int ms);
+#endif // XDRPP_HAVE_EPOLL
+
+#if XDRPP_HAVE_IO_URING
+  struct uring;
+  std::uint64_t uring_seq_ {0};
+  std::unordered_map<std::uint64_t, io_cb_t> io_cbs_;
+  std::unique_ptr<uring> uring_; // Destroyed first, so before io_cbs_
+
+  void uring_update(sock_t s, fd_state &fs, int ops);
+  void uring_fds(int ms);
+#endif // XDRPP_HAVE_IO_URING
+
   // Timeout callback state
-  std::multimap<std::int64_t, cb_t> time_cbs_;
+  detail::timer_wheel time_cbs_ {now_ms()};
 
   cb_t &fd_cb_helper(sock_t s, op_t op);
+  void poll_fds(int ms);
   void consolidate();
   int next_timeout(int ms);
   void run_timeouts();
@@ -71,8 +213,30 @@ private:
   virtual void run_subtype_handlers() {}
 
 public:
-  pollset() = default;
+  //! Without \c XDRPP_HAVE_EPOLL, requests for the \c Epoll backend
+  //! get \c Poll instead.  Requests for \c Uring get the next best
+  //! backend if the kernel cannot provide it.
+  explicit pollset(backend b = default_backend);
   pollset(const pollset &) = delete;
+  virtual ~pollset();
+
+  //! The backend actually in use.
+  backend get_backend() const { return backend_; }
+
+  //! True if the pollset can perform I/O on behalf of its users
+  //! (currently only with the \c Uring backend).
+  bool async_io() const { return backend_ == backend::Uring; }
+#if XDRPP_HAVE_IO_URING
+  //! Queue a \c writev on \c s, to be submitted along with other
+  //! requests on the next call to PollSet::poll, and call \c cb with
+  //! the result once it completes.  \c iov and the bytes it points to
+  //! must remain valid until then, and \c s must stay open at least
+  //! until the request is submitted (see \c submit_io).  Only valid
+  //! if \c async_io() is true.
+  void async_writev(sock_t s, const iovec *iov, int iovcnt, io_cb_t cb);
+  //! Submit queued requests now rather than on the next poll.
+  void submit_io();
+#endif // XDRPP_HAVE_IO_URING
 
   //! Go through one round of checking all file descriptors.  \arg \c
   //! timeout is a timeout in milliseconds (or -1 to wait forever).
@@ -123,21 +287,15 @@ public:
 
   //! Abstract class used to represent a pending timeout.
   class Timeout {
-    using iterator = decltype(time_cbs_)::iterator;
-    iterator i_;
-    explicit Timeout(iterator i) : i_(i) {}
-    Timeout &operator=(iterator i) { i_ = i; return *this; }
+    detail::timer_wheel::node *n_ {nullptr};
+    explicit Timeout(detail::timer_wheel::node *n) : n_(n) {}
     friend class pollset;
   public:
-    //! A null timeout.  Relies on static initalization.
+    //! A null timeout.
     static const Timeout null_;
-    //! After static initialization, Timeouts are null by default.
-    //! However, since \c null_ relies on static initialization,
-    //! static/global Timeouts are not guaranteed to be null and
-    //! should be explicitly initialized from \c
-    //! pollset::timeout_null().
-    Timeout() : i_(null_.i_) {}
-    explicit operator bool() const { return i_ != null_.i_; }
+    //! Timeouts are null by default.
+    constexpr Timeout() = default;
+    explicit operator bool() const { return n_; }
   };
 
   //! Set a callback to run a certain number of milliseconds from now.
@@ -151,7 +309,7 @@ public:
   //! Set a callback to run at a specific time (as returned by
   //! PollSet::now_ms()).
   template<typename CB> Timeout timeout_at(std::int64_t ms, CB &&cb) {
-    return Timeout(time_cbs_.emplace(ms, std::forward<CB>(cb)));
+    return Timeout(time_cbs_.add(ms, cb_t(std::forward<CB>(cb))));
   }
 
   //! An invalid timeout, useful for initializing PollSet::Timeout
@@ -165,10 +323,11 @@ public:
 
   //! Returns the absolute time (in milliseconds) at which a timeout
   //! will run.
-  std::int64_t timeout_time(Timeout t) const { return t.i_->first; }
+  std::int64_t timeout_time(Timeout t) const { return t.n_->when_; }
 
-  //! Reschedule a timeout to run at a specific time.  Updates the
-  //! argument \c t, but invalidates any other copies of \c t.
+  //! Reschedule a timeout to run at a specific time.  Copies of \c t
+  //! remain valid.  A callback may reschedule its own timeout, which
+  //! then runs again rather than being discarded.
   void timeout_reschedule_at(Timeout &t, std::int64_t ms);
   //! Reschedule a timeout some number of milliseconds in the future.
   void timeout_reschedule(Timeout &t, std::int64_t ms) {
@@ -190,18 +349,19 @@ class pollset_plus : public pollset {
     pollset_plus *ps_;
     std::function<R()> work_;
     std::function<void(R)> cb_;
-    std::unique_ptr<R> rp_;
+    std::optional<R> r_;
 
     void start() {
-      rp_.reset(new R { work_() });
-      ps_->inject_cb(std::bind(&async_task::done, this));
+      r_.emplace(work_());
+      ps_->inject_cb([this]() { done(); });
     }
     void done() {
       std::unique_ptr<async_task> self {this};
       ps_->nasync_--;
-      cb_(std::move(*rp_));
+      cb_(std::move(*r_));
     }
   };
+  std::shared_ptr<thread_pool> pool_;
 
   // Self-pipe used to wake up poll from signal handlers and other threads
   sock_t selfpipe_[2];
@@ -229,7 +389,7 @@ class pollset_plus : public pollset {
   static void erase_signal_cb(int);
 
 public:
-  pollset_plus();
+  explicit pollset_plus(backend b = default_backend);
   ~pollset_plus();
 
   bool pending() const override;
@@ -260,15 +420,28 @@ public:
   //! be convertible to std::function<R()> for some type \c R.  \arg
   //! \c cb is the callback that processes the result in the main
   //! thread, and must be convertible to std::function<void(R)> for
-  //! the same type \c R.
+  //! the same type \c R.  The work runs on the thread pool returned
+  //! by \c pool, waiting for a free worker if all are busy.
   template<typename Work, typename CB> void async(Work &&work, CB &&cb) {
     using R = decltype(work());
     async_task<R> *a = new async_task<R> {
-      this, std::forward<Work>(work), std::forward<CB>(cb), nullptr
+      this, std::forward<Work>(work), std::forward<CB>(cb), std::nullopt
     };
     ++nasync_;
-    std::thread(&async_task<R>::start, a).detach();
+    pool().submit([a]() { a->start(); });
+  }
+
+  //! The workers on which \c async runs tasks, by default
+  //! thread_pool::shared().
+  thread_pool &pool() {
+    if (!pool_)
+      pool_ = thread_pool::shared();
+    return *pool_;
   }
+  //! Run \c async tasks on \c p instead, for instance to give a
+  //! group of pollsets a pool of their own.  Tasks already started
+  //! finish on the old pool.
+  void set_pool(std::shared_ptr<thread_pool> p) { pool_ = std::move(p); }
 
   //! Add a callback for a particular signal.  Note that only one
   //! callback can be added for a particular signal across all
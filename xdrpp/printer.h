@@ -57,6 +57,22 @@ struct Printer {
   void operator()(const char *field, const opaque_vec<N> &v) {
     p(field, hexdump(v.data(), v.size()));
   }
+  template<std::uint32_t N>
+  void operator()(const char *field, const pmr::xstring<N> &s) {
+    p(field, escape_string(std::string(s)));
+  }
+  template<std::uint32_t N>
+  void operator()(const char *field, const pmr::opaque_vec<N> &v) {
+    p(field, hexdump(v.data(), v.size()));
+  }
+  template<std::uint32_t N>
+  void operator()(const char *field, const xstring_view<N> &s) {
+    p(field, escape_string(std::string(s)));
+  }
+  template<std::uint32_t N>
+  void operator()(const char *field, const opaque_view<N> &v) {
+    p(field, hexdump(v.data(), v.size()));
+  }
 
   template<typename T> ENABLE_IF(xdr_traits<T>::is_enum)
   operator()(const char *field, T t) {
@@ -82,6 +98,14 @@ struct Printer {
       bol(field) << "NULL";
   }
 
+  template<typename T>
+  void operator()(const char *field, const pmr::pointer<T> &t) {
+    if (t)
+      archive(*this, *t, field);
+    else
+      bol(field) << "NULL";
+  }
+
   template<typename T> ENABLE_IF(xdr_traits<T>::is_class)
   operator()(const char *field, const T &t) {
     bool skipnl = !field;
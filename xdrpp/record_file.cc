@@ -0,0 +1,334 @@
+
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <xdrpp/record_file.h>
+
+namespace xdr {
+
+namespace {
+int
+open_append(const std::string &path)
+{
+  int fd = open(path.c_str(), O_WRONLY|O_CREAT|O_APPEND, 0666);
+  if (fd == -1)
+    throw xdr_system_error(("record_writer: " + path).c_str());
+  return fd;
+}
+
+void
+write_all(int fd, const char *p, std::size_t n, const char *what)
+{
+  while (n > 0) {
+    ssize_t r = write(fd, p, n);
+    if (r == -1) {
+      if (errno == EINTR)
+	continue;
+      throw xdr_system_error(what);
+    }
+    p += r;
+    n -= r;
+  }
+}
+}
+
+record_reader::record_reader(const std::string &path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw xdr_system_error(("record_reader: " + path).c_str());
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    int err = errno;
+    close(fd);
+    throw xdr_system_error("record_reader: fstat", err);
+  }
+  size_ = sb.st_size;
+  if (size_) {
+    void *p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      int err = errno;
+      close(fd);
+      throw xdr_system_error("record_reader: mmap", err);
+    }
+    std::size_t size = size_;
+    map_.reset(static_cast<const char *>(p), [size](const char *p) {
+	munmap(const_cast<char *>(p), size);
+      });
+  }
+  close(fd);
+}
+
+record_reader::record
+record_reader::at_offset(std::size_t offset) const
+{
+  if (offset & 3)
+    throw xdr_bad_message_size("record_reader: misaligned record offset");
+  if (offset > size_ || size_ - offset < 4)
+    throw xdr_bad_message_size("record_reader: truncated record mark");
+  std::uint32_t mark =
+    swap32le(*reinterpret_cast<const std::uint32_t *>(map_.get() + offset));
+  if (!(mark & 0x80000000))
+    throw xdr_bad_message_size("record_reader: multi-fragment records"
+			       " not supported");
+  std::size_t len = mark & 0x7fffffff;
+  if (len & 3)
+    throw xdr_bad_message_size("record_reader: record size not"
+			       " multiple of 4");
+  if (size_ - offset - 4 < len)
+    throw xdr_bad_message_size("record_reader: truncated record");
+  return record{map_.get() + offset + 4, len, offset};
+}
+
+void
+record_reader::build_index()
+{
+  index_.clear();
+  for (std::size_t off = 0; off < size_; off = at_offset(off).next())
+    index_.push_back(off);
+  indexed_ = true;
+}
+
+void
+record_reader::load_index(const std::string &path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw xdr_system_error(("record_reader: " + path).c_str());
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    int err = errno;
+    close(fd);
+    throw xdr_system_error("record_reader: fstat", err);
+  }
+  std::size_t size = sb.st_size;
+  if (size % 8) {
+    close(fd);
+    throw xdr_bad_message_size("record_reader: index size not multiple of 8");
+  }
+  std::vector<std::uint64_t> buf(size / 8);
+  char *p = reinterpret_cast<char *>(buf.data());
+  for (std::size_t pos = 0; pos < size;) {
+    ssize_t n = read(fd, p + pos, size - pos);
+    if (n <= 0) {
+      if (n == -1 && errno == EINTR)
+	continue;
+      int err = n ? errno : EIO;
+      close(fd);
+      throw xdr_system_error("record_reader: read index", err);
+    }
+    pos += n;
+  }
+  close(fd);
+
+  xdr_get g(p, p + size);
+  index_.resize(buf.size());
+  for (std::uint64_t &off : index_)
+    xdr::archive(g, off);
+  indexed_ = true;
+}
+
+void
+record_reader::advise_sequential() const
+{
+  if (size_)
+    madvise(const_cast<char *>(map_.get()), size_, MADV_SEQUENTIAL);
+}
+
+void
+record_reader::advise_random() const
+{
+  if (size_)
+    madvise(const_cast<char *>(map_.get()), size_, MADV_RANDOM);
+}
+
+record_writer::record_writer(const std::string &path,
+			     const std::string &index_path)
+  : fd_(open_append(path))
+{
+  struct stat sb;
+  if (fstat(fd_, &sb) == -1) {
+    int err = errno;
+    close(fd_);
+    throw xdr_system_error("record_writer: fstat", err);
+  }
+  offset_ = sb.st_size;
+  if (!index_path.empty()) {
+    try {
+      ifd_ = open_append(index_path);
+    }
+    catch (...) {
+      close(fd_);
+      throw;
+    }
+    if (fstat(ifd_, &sb) == -1) {
+      int err = errno;
+      close(ifd_);
+      close(fd_);
+      throw xdr_system_error("record_writer: fstat", err);
+    }
+    ioffset_ = sb.st_size;
+  }
+}
+
+record_writer::~record_writer()
+{
+  try {
+    commit();
+  }
+  catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+  }
+  if (ps_)
+    ps_->timeout_cancel(timeout_);
+  close(fd_);
+  if (ifd_ != -1)
+    close(ifd_);
+}
+
+void
+record_writer::check_failed() const
+{
+  if (failed_)
+    throw xdr_runtime_error("record_writer: unusable after failed commit");
+}
+
+std::uint64_t
+record_writer::append(msg_ptr &m)
+{
+  check_failed();
+  if (m->size() > 0x7fffffff || m->size() & 3)
+    throw xdr_bad_message_size("record_writer: message size not valid for"
+			       " a single-fragment record");
+  if (queue_.empty()) {
+    oldest_ = clock::now();
+    arm_timeout();
+  }
+  std::uint64_t off = offset_;
+  std::size_t size = m->raw_size();
+  offset_ += size;
+  qbytes_ += size;
+  qoffsets_.push_back(off);
+  queue_.push_back(std::move(m));
+  if (qbytes_ >= batch_bytes_ || clock::now() - oldest_ >= window_)
+    commit();
+  return off;
+}
+
+// Schedule a commit of the queue when the window expires.
+void
+record_writer::arm_timeout()
+{
+  if (!ps_ || window_ <= clock::duration::zero())
+    return;
+  using namespace std::chrono;
+  timeout_ = ps_->timeout(ceil<milliseconds>(window_).count(), [this]() {
+      timeout_ = pollset::timeout_null();
+      try {
+	commit();
+	error_ = nullptr;
+      }
+      catch (const std::exception &) {
+	error_ = std::current_exception();
+      }
+    });
+}
+
+void
+record_writer::commit()
+{
+  if (ps_)
+    ps_->timeout_cancel(timeout_);
+  check_failed();
+  if (queue_.empty())
+    return;
+
+  batch_stats st;
+  st.records = queue_.size();
+  st.bytes = qbytes_;
+  clock::time_point start = clock::now(), written;
+  try {
+    st.writes = write_queue(queue_);
+    if (ifd_ != -1)
+      write_index(qoffsets_);
+    written = clock::now();
+    if (sync_ && fdatasync(fd_) == -1)
+      throw xdr_system_error("record_writer: fdatasync");
+  }
+  catch (...) {
+    // Cut off any part of the batch that was written, so that the
+    // offsets already returned by append stay correct when the
+    // batch is retried.
+    if (ftruncate(fd_, qoffsets_.front()) == -1
+	|| (ifd_ != -1 && ftruncate(ifd_, ioffset_) == -1))
+      failed_ = true;
+    else
+      arm_timeout();		// Retry after another window
+    throw;
+  }
+  clock::time_point synced = clock::now();
+  if (ifd_ != -1)
+    ioffset_ += 8 * qoffsets_.size();
+
+  st.write_time = written - start;
+  st.sync_time = synced - written;
+  st.latency = synced - oldest_;
+  queue_.clear();
+  qoffsets_.clear();
+  qbytes_ = 0;
+  if (stats_cb_)
+    stats_cb_(st);
+}
+
+// Write a batch with as few calls to writev as possible, returning
+// the number of calls.
+std::size_t
+record_writer::write_queue(const std::vector<msg_ptr> &q)
+{
+  static constexpr std::size_t maxiov = 1024;
+  iovec v[maxiov];
+  std::size_t writes = 0;
+  std::size_t i = 0, skip = 0;	// Bytes of q[i] already written
+  while (i < q.size()) {
+    std::size_t n = 0;
+    for (std::size_t j = i; j < q.size() && n < maxiov; ++j, ++n) {
+      std::size_t s = j == i ? skip : 0;
+      v[n].iov_base = q[j]->raw_data() + s;
+      v[n].iov_len = q[j]->raw_size() - s;
+    }
+    ssize_t r = writev(fd_, v, n);
+    ++writes;
+    if (r == -1) {
+      if (errno == EINTR)
+	continue;
+      throw xdr_system_error("record_writer: writev");
+    }
+    for (std::size_t left = r; left > 0;) {
+      std::size_t rest = q[i]->raw_size() - skip;
+      if (left < rest) {
+	skip += left;
+	break;
+      }
+      left -= rest;
+      skip = 0;
+      ++i;
+    }
+  }
+  return writes;
+}
+
+void
+record_writer::write_index(const std::vector<std::uint64_t> &offsets)
+{
+  msg_ptr m = message_t::alloc(8 * offsets.size());
+  xdr_put p(m);
+  for (std::uint64_t off : offsets)
+    archive(p, off);
+  write_all(ifd_, m->data(), m->size(), "record_writer: write index");
+}
+
+}
@@ -0,0 +1,362 @@
+// -*- C++ -*-
+
+/** \file record_file.h Files of XDR records.  A record file is the
+ * concatenation of messages as they appear on the wire (i.e., the
+ * bytes of xdr::message_t::raw_data): a 4-byte RFC5531 record mark
+ * followed by the XDR body.  xdr::record_reader maps such a file into
+ * memory and unmarshals records in place, while xdr::record_writer
+ * appends to one with group commit.
+ */
+
+#ifndef _XDRPP_RECORD_FILE_H_HEADER_INCLUDED_
+#define _XDRPP_RECORD_FILE_H_HEADER_INCLUDED_ 1
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <xdrpp/exception.h>
+#include <xdrpp/marshal.h>
+#include <xdrpp/pollset.h>
+
+namespace xdr {
+
+//! Memory-mapped, read-only access to a file of XDR records.  Records
+//! are located by walking record marks lazily, so scanning a file
+//! never copies it.  Calling \c build_index additionally allows
+//! constant-time access to the Nth record.  Each record body must be
+//! a single fragment and a multiple of 4 bytes long (as produced by
+//! writing \c message_t::raw_data), which keeps every body 4-byte
+//! aligned in the mapping.
+class record_reader {
+public:
+  //! The location of one record within the mapping.
+  struct record {
+    const char *data;		//!< The XDR body (after the record mark)
+    std::size_t size;		//!< Size of the body
+    std::size_t offset;		//!< File offset of the record mark
+    //! File offset of the following record.
+    std::size_t next() const { return offset + 4 + size; }
+  };
+
+  //! Iterates over records in file order.  Throws
+  //! xdr::xdr_bad_message_size on reaching a malformed or truncated
+  //! record.
+  class iterator {
+    const record_reader *r_ {nullptr};
+    record rec_ {nullptr, 0, 0};
+    friend class record_reader;
+    iterator(const record_reader *r, std::size_t off) : r_(r) {
+      rec_.offset = off;
+      if (off < r_->size_)
+	rec_ = r_->at_offset(off);
+    }
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = record;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const record *;
+    using reference = const record &;
+
+    iterator() = default;
+    const record &operator*() const { return rec_; }
+    const record *operator->() const { return &rec_; }
+    iterator &operator++() { return *this = iterator(r_, rec_.next()); }
+    iterator operator++(int) { iterator old = *this; ++*this; return old; }
+    bool operator==(const iterator &o) const {
+      return rec_.offset == o.rec_.offset;
+    }
+  };
+
+  //! Map \c path read-only.  \throws xdr_system_error if the file
+  //! cannot be opened or mapped.
+  explicit record_reader(const std::string &path);
+  //! Read records from \c size bytes at \c data, which must be
+  //! 4-byte aligned.  The reader (and any views unmarshaled from it)
+  //! share ownership of the buffer.
+  record_reader(std::shared_ptr<const char> data, std::size_t size)
+    : map_(std::move(data)), size_(size) {
+    assert(!(reinterpret_cast<std::uintptr_t>(map_.get()) & 3));
+  }
+  record_reader(const record_reader &) = delete;
+  record_reader &operator=(const record_reader &) = delete;
+
+  //! Size of the file in bytes.
+  std::size_t file_size() const { return size_; }
+
+  //! The record whose mark is at byte \c offset.  \throws
+  //! xdr_bad_message_size if the record is malformed or truncated.
+  record at_offset(std::size_t offset) const;
+
+  iterator begin() const { return iterator(this, 0); }
+  iterator end() const { return iterator(this, size_); }
+
+  //! Walk the whole file once, remembering where each record starts.
+  //! Validates every record mark on the way.
+  void build_index();
+  //! Use an index file written by xdr::record_writer instead of
+  //! scanning the records.  Offsets are checked as records are
+  //! accessed, not up front.  \throws xdr_system_error if the file
+  //! cannot be read.
+  void load_index(const std::string &path);
+  bool indexed() const { return indexed_; }
+  //! Number of records.  Requires \c build_index.
+  std::size_t nrecords() const { assert(indexed_); return index_.size(); }
+  //! Offsets of all records.  Requires \c build_index.
+  const std::vector<std::uint64_t> &index() const {
+    assert(indexed_);
+    return index_;
+  }
+  //! Record number \c n, in constant time.  Requires \c build_index.
+  record operator[](std::size_t n) const {
+    assert(indexed_);
+    return at_offset(index_.at(n));
+  }
+
+  //! An archive over the body of \c r.  Any xdr::opaque_view or
+  //! xdr::xstring_view unmarshaled with it keeps the mapping alive.
+  xdr_get archive(const record &r) const {
+    return xdr_get(r.data, r.data + r.size, map_);
+  }
+  //! Unmarshal the body of \c r into \c args, requiring that the
+  //! whole body be consumed.
+  template<typename...Args> void decode(const record &r, Args &...args) const {
+    xdr_get g(archive(r));
+    xdr_argpack_archive(g, args...);
+    g.done();
+  }
+
+  //! Tell the kernel the file will be scanned in order (more
+  //! aggressive read-ahead) or sampled at random (none).
+  void advise_sequential() const;
+  void advise_random() const;
+
+private:
+  std::shared_ptr<const char> map_;
+  std::size_t size_ {0};
+  std::vector<std::uint64_t> index_;
+  bool indexed_ {false};
+};
+
+//! Call \c f(worker, n, rec) for every record \c rec (record number \c
+//! n) of \c r, on \c nthreads threads (by default, one per core).
+//! Records are split at record boundaries into contiguous chunks of
+//! roughly equal size in bytes, several per thread so that threads
+//! finishing early can take more, and each chunk is processed in
+//! order by a single thread.  \c worker is the index of the thread
+//! (below \c nthreads).  Builds the index of \c r if necessary.  If
+//! \c f throws, remaining chunks are abandoned and the first
+//! exception is rethrown once all threads have stopped.
+template<typename F> void
+parallel_for_records(record_reader &r, F &&f, unsigned nthreads = 0)
+{
+  if (!r.indexed())
+    r.build_index();
+  if (!nthreads)
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  const std::size_t nrec = r.nrecords();
+  if (!nrec)
+    return;
+
+  // Chunk boundaries, as record numbers, balanced by bytes
+  const std::vector<std::uint64_t> &idx = r.index();
+  const std::size_t nchunks = std::min<std::size_t>(nrec, 4 * nthreads);
+  const std::uint64_t start = idx.front(), span = r.file_size() - start;
+  std::vector<std::size_t> bounds {0};
+  for (std::size_t i = 1; i < nchunks; i++) {
+    std::size_t b = std::lower_bound(idx.begin(), idx.end(),
+				     start + i * span / nchunks) - idx.begin();
+    if (b > bounds.back() && b < nrec)
+      bounds.push_back(b);
+  }
+  bounds.push_back(nrec);
+
+  std::atomic<std::size_t> next {0};
+  std::atomic<bool> failed {false};
+  std::exception_ptr err;
+  auto work = [&](unsigned worker) {
+    for (std::size_t c; !failed && (c = next++) + 1 < bounds.size();)
+      try {
+	for (std::size_t n = bounds[c]; n < bounds[c+1] && !failed; n++)
+	  f(worker, n, r[n]);
+      }
+      catch (...) {
+	if (!failed.exchange(true))
+	  err = std::current_exception();
+      }
+  };
+
+  nthreads = std::min<std::size_t>(nthreads, bounds.size() - 1);
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < nthreads; i++)
+    threads.emplace_back(work, i);
+  work(0);
+  for (std::thread &t : threads)
+    t.join();
+  if (err)
+    std::rethrow_exception(err);
+}
+
+namespace detail {
+// Decode without sharing ownership of the mapping, because threads
+// contending for its reference count would not scale.
+template<typename T> void
+decode_record(const record_reader::record &rec, T &t)
+{
+  xdr_get g(rec.data, rec.data + rec.size);
+  archive(g, t);
+  g.done();
+}
+}
+
+//! Unmarshal every record of \c r as a \c T, in parallel (see
+//! xdr::parallel_for_records).  Element \c n of the result is record
+//! number \c n.  Unlike with \c record_reader::decode, any views in
+//! the results are only valid as long as \c r.
+template<typename T> std::vector<T>
+parallel_decode(record_reader &r, unsigned nthreads = 0)
+{
+  if (!r.indexed())
+    r.build_index();
+  std::vector<T> out(r.nrecords());
+  parallel_for_records(r, [&](unsigned, std::size_t n,
+			      const record_reader::record &rec) {
+      detail::decode_record(rec, out[n]);
+    }, nthreads);
+  return out;
+}
+
+//! Like xdr::parallel_decode, but without preserving order: each
+//! thread appends to its own vector, and the result holds one vector
+//! per thread.
+template<typename T> std::vector<std::vector<T>>
+parallel_decode_unordered(record_reader &r, unsigned nthreads = 0)
+{
+  if (!nthreads)
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::vector<T>> out(nthreads);
+  parallel_for_records(r, [&](unsigned w, std::size_t,
+			      const record_reader::record &rec) {
+      detail::decode_record(rec, out[w].emplace_back());
+    }, nthreads);
+  return out;
+}
+
+//! Appends records to a file in the format read by
+//! xdr::record_reader, committing them in batches.  Records passed to
+//! \c append are queued, then written with as few \c writev calls as
+//! possible and made durable with a single \c fdatasync once the
+//! group-commit window has passed since the oldest queued record, the
+//! queue exceeds the batch size, or \c commit is called.  With a
+//! window of zero (the default), every record is committed as it is
+//! appended.  Since the window is only checked by \c append, pass a
+//! pollset to \c attach to have queued records committed even when
+//! no more arrive.
+//!
+//! Optionally, the writer also maintains an index file holding the
+//! offset of every record as an XDR unsigned hyper (see \c
+//! record_reader::load_index).  The index is written with each batch
+//! but not synced, since it can always be rebuilt from the records.
+//! It only covers records appended while it was being maintained.
+class record_writer {
+public:
+  using clock = std::chrono::steady_clock;
+
+  //! Statistics on one committed batch.
+  struct batch_stats {
+    std::size_t records;	//!< Number of records in the batch
+    std::size_t bytes;		//!< Bytes written, including record marks
+    std::size_t writes;		//!< Calls to \c writev
+    clock::duration write_time;	//!< Time spent writing
+    clock::duration sync_time;	//!< Time spent in \c fdatasync
+    //! From the oldest record being appended to the batch being
+    //! durable.
+    clock::duration latency;
+  };
+  using stats_cb_t = std::function<void(const batch_stats &)>;
+
+  static constexpr std::size_t default_batch_bytes = 0x100000;
+
+  //! Open \c path for appending, creating it if necessary.  If \c
+  //! index_path is not empty, also append record offsets to that
+  //! file.  \throws xdr_system_error if a file cannot be opened.
+  explicit record_writer(const std::string &path,
+			 const std::string &index_path = "");
+  //! Commits any queued records (ignoring errors).
+  ~record_writer();
+  record_writer(const record_writer &) = delete;
+  record_writer &operator=(const record_writer &) = delete;
+
+  //! Queue a record (taking ownership of \c m), committing the batch
+  //! if it is due.  Returns the offset of the record in the file.
+  //! \throws xdr_bad_message_size if the message is too large for a
+  //! single-fragment record, or xdr_system_error if a commit fails
+  //! (in which case the record stays queued).
+  std::uint64_t append(msg_ptr &m);
+  std::uint64_t append(msg_ptr &&m) { return append(m); }
+  //! Write and sync all queued records.  If this fails, whatever part
+  //! of the batch reached the files is truncated away and the records
+  //! stay queued, so a later commit writes them at the offsets \c
+  //! append returned.  If even the truncation fails, the writer is
+  //! unusable and every later call throws.
+  void commit();
+
+  //! How long a record may wait for others to share its commit.
+  void set_commit_window(clock::duration d) { window_ = d; }
+  //! Commit as soon as this many bytes are queued.
+  void set_batch_bytes(std::size_t n) { batch_bytes_ = n; }
+  //! Whether to \c fdatasync each batch (default \c true).
+  void set_sync(bool sync) { sync_ = sync; }
+  //! Called after every committed batch.
+  template<typename T> void set_stats_cb(T &&cb) {
+    stats_cb_ = std::forward<T>(cb);
+  }
+  //! Commit batches from a timeout on \c ps when the window expires,
+  //! rather than waiting for the next \c append.  The pollset must
+  //! outlive the writer.  A commit that fails in the timeout does not
+  //! throw from \c pollset::poll; instead see \c error.  After any
+  //! failed commit, the records stay queued and are retried from a
+  //! timeout every window until a commit succeeds.
+  void attach(pollset &ps) { ps_ = &ps; }
+  //! The exception from the last commit run by the timeout, or null
+  //! if it succeeded.  Failed records remain queued.
+  std::exception_ptr error() const { return error_; }
+
+  //! File size once all queued records are written.
+  std::uint64_t offset() const { return offset_; }
+  //! Number of records queued but not yet committed.
+  std::size_t pending() const { return queue_.size(); }
+
+private:
+  int fd_ {-1};
+  int ifd_ {-1};
+  std::uint64_t offset_ {0};
+  std::uint64_t ioffset_ {0};	// Size of the index file
+  bool failed_ {false};
+  std::exception_ptr error_;
+  std::vector<msg_ptr> queue_;
+  std::vector<std::uint64_t> qoffsets_;
+  std::size_t qbytes_ {0};
+  clock::time_point oldest_;
+  clock::duration window_ {0};
+  std::size_t batch_bytes_ {default_batch_bytes};
+  bool sync_ {true};
+  stats_cb_t stats_cb_;
+  pollset *ps_ {nullptr};
+  pollset::Timeout timeout_ {pollset::timeout_null()};
+
+  void check_failed() const;
+  void arm_timeout();
+  std::size_t write_queue(const std::vector<msg_ptr> &q);
+  void write_index(const std::vector<std::uint64_t> &offsets);
+};
+
+}
+
+#endif // !_XDRPP_RECORD_FILE_H_HEADER_INCLUDED_
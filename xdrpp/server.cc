@@ -129,7 +129,8 @@ rpc_tcp_listener_common::rpc_tcp_listener_common(pollset &ps, unique_sock &&s,
 
 rpc_tcp_listener_common::~rpc_tcp_listener_common()
 {
-  ps_.fd_cb(listen_sock_.get(), pollset::Read);
+  if (listen_sock_)
+    ps_.fd_cb(listen_sock_.get(), pollset::Read);
   // XXX should clean up if use_rpcbind_.
 }
 
@@ -143,27 +144,181 @@ rpc_tcp_listener_common::accept_cb()
     return;
   }
   set_close_on_exec(s);
-  rpc_sock *ms = new rpc_sock(ps_, s);
+  serve(s);
+}
+
+void
+rpc_tcp_listener_common::serve(sock_t s)
+{
+  bump(naccepted_);
+  rpc_sock *ms = new rpc_sock(ps_, s, rpc_sock::rcb_t(nullptr), maxmsglen());
+  void *session = session_alloc(ms);
+  conns_.emplace(ms, session);
   ms->set_servcb(std::bind(&rpc_tcp_listener_common::receive_cb, this, ms,
-			   session_alloc(ms), std::placeholders::_1));
+			   session, std::placeholders::_1));
+}
+
+void
+rpc_tcp_listener_common::drop(rpc_sock *ms, void *session)
+{
+  conns_.erase(ms);
+  session_free(session);
+  delete ms;
+  bump(nclosed_);
+}
+
+void
+rpc_tcp_listener_common::close_all()
+{
+  while (!conns_.empty()) {
+    auto c = conns_.begin();
+    drop(c->first, c->second);
+  }
 }
 
 void
 rpc_tcp_listener_common::receive_cb(rpc_sock *ms, void *session, msg_ptr mp)
 {
   if (!mp) {
-    session_free(session);
-    delete ms;
+    drop(ms, session);
     return;
   }
+  bump(ncalls_);
   try {
     dispatch(session, std::move(mp), rpc_sock_reply_t(ms));
   }
   catch (const xdr_runtime_error &e) {
     std::cerr << e.what() << std::endl;
-    session_free(session);
-    delete ms;
+    drop(ms, session);
+  }
+}
+
+rpc_listener_stats
+rpc_tcp_listener_common::stats() const
+{
+  std::uint64_t closed = nclosed_.load(std::memory_order_relaxed);
+  std::uint64_t accepted = naccepted_.load(std::memory_order_relaxed);
+  return { accepted, accepted - closed,
+	   ncalls_.load(std::memory_order_relaxed) };
+}
+
+
+rpc_tcp_group_common::rpc_tcp_group_common(std::size_t nthreads,
+					   const char *service,
+					   mode m, int family)
+  : mode_(m)
+{
+  if (!nthreads)
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t i = 0; i < nthreads; i++)
+    shards_.emplace_back(new shard);
+
+  if (mode_ == mode::ReusePort) {
+    // Bind the rest to the port of the first, in case it was ephemeral
+    std::string port;
+    for (auto &s : shards_) {
+      s->sock_ = tcp_listen(port.empty() ? service : port.c_str(), family,
+			    SOMAXCONN, true);
+      set_close_on_exec(s->sock_.get());
+      if (port.empty()) {
+	port_ = parse_uaddr_port(make_uaddr(s->sock_.get()));
+	port = std::to_string(port_);
+      }
+    }
+  }
+  else {
+    accept_sock_ = tcp_listen(service, family, SOMAXCONN);
+    set_close_on_exec(accept_sock_.get());
+    port_ = parse_uaddr_port(make_uaddr(accept_sock_.get()));
+    shards_[0]->ps_.fd_cb(accept_sock_.get(), pollset::Read,
+			  std::bind(&rpc_tcp_group_common::accept_cb, this));
   }
 }
 
+rpc_tcp_group_common::~rpc_tcp_group_common()
+{
+  stop();
+  if (accept_sock_)
+    shards_[0]->ps_.fd_cb(accept_sock_.get(), pollset::Read);
+}
+
+void
+rpc_tcp_group_common::accept_cb()
+{
+  sock_t s = accept(accept_sock_.get(), nullptr, 0);
+  if (s == invalid_sock) {
+    std::cerr << "rpc_tcp_group_common: accept: " << sock_errmsg()
+	      << std::endl;
+    return;
+  }
+  set_close_on_exec(s);
+  shard &sh = *shards_[next_++ % shards_.size()];
+  if (&sh == shards_[0].get()) {
+    sh.listener_->serve(s);
+    return;
+  }
+  // Queued rather than captured, so that stop can close descriptors
+  // whose shard exits before serving them.
+  {
+    std::lock_guard<std::mutex> lk(sh.mu_);
+    sh.pending_.push_back(s);
+  }
+  sh.ps_.inject_cb([&sh]() { sh.serve_pending(); });
+}
+
+void
+rpc_tcp_group_common::shard::serve_pending()
+{
+  std::vector<sock_t> v;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    v.swap(pending_);
+  }
+  for (sock_t s : v)
+    listener_->serve(s);
+}
+
+void
+rpc_tcp_group_common::start()
+{
+  stop_ = false;
+  for (auto &s : shards_) {
+    assert(s->listener_ && !s->thread_.joinable());
+    s->thread_ = std::thread([this, &ps = s->ps_]() {
+	while (!stop_)
+	  ps.poll();
+      });
+  }
+}
+
+void
+rpc_tcp_group_common::stop()
+{
+  stop_ = true;
+  for (auto &s : shards_)
+    if (s->thread_.joinable()) {
+      s->ps_.wake();
+      s->thread_.join();
+      // With the thread joined, its pollset belongs to this one.
+      // Connections must be closed before the pollset is destroyed.
+      std::vector<sock_t> v;
+      {
+	std::lock_guard<std::mutex> lk(s->mu_);
+	v.swap(s->pending_);
+      }
+      for (sock_t fd : v)
+	close(fd);
+      s->listener_->close_all();
+    }
+}
+
+std::vector<rpc_listener_stats>
+rpc_tcp_group_common::stats() const
+{
+  std::vector<rpc_listener_stats> v;
+  for (auto &s : shards_)
+    v.push_back(s->listener_->stats());
+  return v;
+}
+
 }
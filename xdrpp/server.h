@@ -11,6 +11,7 @@
 #ifndef _XDRPP_SERVER_H_HEADER_INCLUDED_
 #define _XDRPP_SERVER_H_HEADER_INCLUDED_ 1
 
+#include <atomic>
 #include <iostream>
 #include <xdrpp/marshal.h>
 #include <xdrpp/printer.h>
@@ -18,6 +19,8 @@
 #include <xdrpp/rpcbind.h>
 #include <xdrpp/rpc_msg.hh>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 
 namespace xdr {
 
@@ -214,6 +217,32 @@ struct service_base {
   }
 };
 
+namespace detail {
+template<typename...P> constexpr std::uint64_t
+max_args_bound(std::tuple<P...> *)
+{
+  std::uint64_t n = 0;
+  ((n = std::max(n, size_bound<typename P::arg_tuple_type>())), ...);
+  return n;
+}
+
+template<typename Interface> constexpr std::size_t
+max_call_size()
+{
+  std::uint64_t n = bound_add(
+    size_bound<rpc_msg>(),
+    max_args_bound(static_cast<typename Interface::_xdr_procs *>(nullptr)));
+  return n <= 0xffffffff ? std::size_t(n) : 0;
+}
+}
+
+//! The size of the largest call message any procedure of \c Interface
+//! can receive (the RPC header plus arguments), or 0 if some procedure
+//! takes arguments without a bounded size (see
+//! xdr::xdr_has_bounded_size).
+template<typename Interface> constexpr std::size_t rpc_max_call_size =
+  detail::max_call_size<Interface>();
+
 class rpc_server_base {
   std::map<uint32_t,
 	   std::map<uint32_t, std::unique_ptr<service_base>>> servers_;
@@ -224,26 +253,80 @@ public:
 };
 
 
+//! Counts of a listener's activity.
+struct rpc_listener_stats {
+  std::uint64_t accepted;	//!< Connections served
+  std::uint64_t active;		//!< Connections not yet closed
+  std::uint64_t calls;		//!< Messages received
+};
+
 //! Listens for connections on a TCP socket (optionally registering
 //! the socket with \c rpcbind), and then serves one or more
 //! program/version interfaces to accepted connections.
 class rpc_tcp_listener_common : public rpc_server_base {
+  // Written only by the thread running ps_, but read by any thread
+  std::atomic<std::uint64_t> naccepted_ {0};
+  std::atomic<std::uint64_t> nclosed_ {0};
+  std::atomic<std::uint64_t> ncalls_ {0};
+  static void bump(std::atomic<std::uint64_t> &n) {
+    n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  // Open connections and their sessions
+  std::unordered_map<rpc_sock *, void *> conns_;
+
   void accept_cb();
   void receive_cb(rpc_sock *ms, void *session, msg_ptr mp);
+  void drop(rpc_sock *ms, void *session);
 
 protected:
   unique_sock listen_sock_;
   const bool use_rpcbind_;
+  std::size_t max_call_ {0};
+  bool unbounded_call_ {false};
+  //! Account for a service whose largest call is \c n bytes (0 if
+  //! unbounded).
+  void note_max_call(std::size_t n) {
+    if (n)
+      max_call_ = std::max(max_call_, n);
+    else
+      unbounded_call_ = true;
+  }
   rpc_tcp_listener_common(pollset &ps, unique_sock &&s,
 			  bool use_rpcbind = false);
   rpc_tcp_listener_common(pollset &ps)
     : rpc_tcp_listener_common(ps, unique_sock(invalid_sock), true) {}
+  //! A listener without a socket, serving only connections passed to
+  //! \c serve.
+  rpc_tcp_listener_common(pollset &ps, std::nullptr_t)
+    : use_rpcbind_(false), ps_(ps) {}
   virtual ~rpc_tcp_listener_common();
   virtual void *session_alloc(rpc_sock *) = 0;
   virtual void session_free(void *session) = 0;
 
 public:
   pollset &ps_;
+
+  //! The \c maxmsglen of accepted connections.  If every registered
+  //! service takes only arguments of bounded size, this is the
+  //! largest call any of them can receive; otherwise it is
+  //! msg_sock::default_maxmsglen.
+  std::size_t maxmsglen() const {
+    return unbounded_call_ || !max_call_ ? msg_sock::default_maxmsglen
+      : max_call_;
+  }
+
+  //! Serve an already-accepted connection, taking ownership of \c s.
+  //! Call only from the thread running \c ps_.
+  void serve(sock_t s);
+
+  //! Close every connection still open and free its session.  Call
+  //! only from the thread running \c ps_.
+  void close_all();
+
+  //! Activity so far.  Unlike most methods, safe to call from any
+  //! thread.
+  rpc_listener_stats stats() const;
 };
 
 template<template<typename, typename, typename> class ServiceType,
@@ -262,18 +345,121 @@ public:
   generic_rpc_tcp_listener(pollset &ps, unique_sock &&s, bool use_rpcbind,
 			   SessionAllocator sa)
     : rpc_tcp_listener_common(ps, std::move(s), use_rpcbind), sa_(sa) {}
-  ~generic_rpc_tcp_listener() {}
+  generic_rpc_tcp_listener(pollset &ps, std::nullptr_t, SessionAllocator sa)
+    : rpc_tcp_listener_common(ps, nullptr), sa_(sa) {}
+  ~generic_rpc_tcp_listener() { close_all(); }
 
   //! Add objects implementing RPC program interfaces to the server.
   template<typename T, typename Interface = typename T::rpc_interface_type>
   void register_service(T &t) {
     register_service_base(new ServiceType<T,Session,Interface>(t));
+    note_max_call(rpc_max_call_size<Interface>);
     if(use_rpcbind_)
       rpcbind_register(listen_sock_.get(), Interface::program,
 		       Interface::version);
   }
 };
 
+//! Serves RPCs on several threads, each with its own \c pollset_plus
+//! and listener, so that a server is not limited to one core.  Every
+//! connection stays on the thread that accepts it.  Construct the
+//! group, register services, then call \c start.
+class rpc_tcp_group_common {
+public:
+  //! How connections reach the threads.  With \c ReusePort, each
+  //! thread listens on its own socket bound to the same port with \c
+  //! SO_REUSEPORT, and the kernel spreads connections among them.
+  //! With \c Acceptor, the first thread accepts every connection and
+  //! deals them out in turn.
+  enum class mode { ReusePort, Acceptor };
+#ifdef SO_REUSEPORT
+  static constexpr mode default_mode = mode::ReusePort;
+#else // !SO_REUSEPORT
+  static constexpr mode default_mode = mode::Acceptor;
+#endif // !SO_REUSEPORT
+
+private:
+  const mode mode_;
+  unique_sock accept_sock_;	// Only with mode::Acceptor
+  std::size_t next_ {0};
+  int port_;
+  std::atomic<bool> stop_ {false};
+
+  void accept_cb();
+
+protected:
+  struct shard {
+    pollset_plus ps_;
+    unique_sock sock_;		// Until passed to the listener
+    rpc_tcp_listener_common *listener_ {nullptr};
+    std::thread thread_;
+    std::mutex mu_;
+    std::vector<sock_t> pending_; // Dealt out but not yet served
+    void serve_pending();
+  };
+  std::vector<std::unique_ptr<shard>> shards_;
+
+  //! Zero \c nthreads means one per hardware thread.
+  rpc_tcp_group_common(std::size_t nthreads, const char *service,
+		       mode m, int family);
+  //! Derived classes must set each \c shard::listener_.
+  ~rpc_tcp_group_common();
+
+public:
+  //! Start serving.  No services may be registered after this.
+  void start();
+  //! Stop and join the threads, then close any connections still
+  //! open.  Called automatically on destruction.  The group may be
+  //! started again afterwards.
+  void stop();
+
+  std::size_t size() const { return shards_.size(); }
+  mode get_mode() const { return mode_; }
+  //! The port on which the group listens.
+  int port() const { return port_; }
+  //! The pollset of thread \c i, for example to \c inject_cb work on
+  //! it.
+  pollset_plus &ps(std::size_t i) { return shards_.at(i)->ps_; }
+  //! Per-thread activity.
+  std::vector<rpc_listener_stats> stats() const;
+};
+
+template<template<typename, typename, typename> class ServiceType,
+	 typename Session, typename SessionAllocator>
+class generic_rpc_tcp_group : public rpc_tcp_group_common {
+  using listener_t =
+    generic_rpc_tcp_listener<ServiceType, Session, SessionAllocator>;
+  std::vector<std::unique_ptr<listener_t>> listeners_;
+
+public:
+  explicit generic_rpc_tcp_group(std::size_t nthreads = 0,
+				 const char *service = nullptr,
+				 mode m = default_mode,
+				 int family = AF_UNSPEC,
+				 SessionAllocator sa = SessionAllocator())
+    : rpc_tcp_group_common(nthreads, service, m, family) {
+    for (auto &s : shards_) {
+      if (s->sock_)
+	listeners_.emplace_back(new listener_t(s->ps_, std::move(s->sock_),
+					       false, sa));
+      else
+	listeners_.emplace_back(new listener_t(s->ps_, nullptr, sa));
+      s->listener_ = listeners_.back().get();
+    }
+  }
+  // The threads must stop before the listeners are destroyed
+  ~generic_rpc_tcp_group() { stop(); }
+
+  //! Add objects implementing RPC program interfaces to every thread.
+  //! The same \c t serves calls on all threads at once, so its
+  //! methods must be thread-safe.
+  template<typename T, typename Interface = typename T::rpc_interface_type>
+  void register_service(T &t) {
+    for (auto &l : listeners_)
+      l->template register_service<T, Interface>(t);
+  }
+};
+
 
 } // namespace xdr
 
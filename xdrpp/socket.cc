@@ -157,13 +157,25 @@ bindable_address(const char *service, int family, int socktype)
 }
 
 unique_sock
-tcp_listen(const char *service, int family, int backlog)
+tcp_listen(const char *service, int family, int backlog, bool reuseport)
 {
   unique_addrinfo ai = bindable_address(service, family, SOCK_STREAM);
   unique_sock s(sock_t(socket(ai->ai_family, ai->ai_socktype,
 			      ai->ai_protocol)));
   if (!s)
     throw_sockerr("socket");
+  if (reuseport) {
+#ifdef SO_REUSEPORT
+    int one = 1;
+    if (setsockopt(s.get().fd_, SOL_SOCKET, SO_REUSEPORT,
+		   reinterpret_cast<const char *>(&one), sizeof(one)) == -1)
+      throw_sockerr("setsockopt(SO_REUSEPORT)");
+#else // !SO_REUSEPORT
+    throw std::system_error(
+      std::make_error_code(std::errc::operation_not_supported),
+      "SO_REUSEPORT");
+#endif // !SO_REUSEPORT
+  }
   if (bind(s.get().fd_, ai->ai_addr, ai->ai_addrlen) == -1)
     throw_sockerr("bind");
   if (listen(s.get().fd_, backlog) == -1)
@@ -177,10 +177,14 @@ tcp_connect(const unique_addrinfo &ai)
 unique_sock tcp_connect(const char *host, const char *service,
 			int family = AF_UNSPEC);
 
-//! Create bind a listening TCP socket.
+//! Create bind a listening TCP socket.  With \c reuseport, sets \c
+//! SO_REUSEPORT so that several sockets can listen on the same port,
+//! with the kernel spreading connections among them (throwing \c
+//! std::system_error where that is unsupported).
 unique_sock tcp_listen(const char *service = nullptr,
 		       int family = AF_UNSPEC,
-		       int backlog = 5);
+		       int backlog = 5,
+		       bool reuseport = false);
 
 //! Create and bind a UDP socket.
 unique_sock udp_listen(const char *service = nullptr,
@@ -1,8 +1,10 @@
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <unistd.h>
+#include <sys/uio.h>
 #include <xdrpp/exception.h>
 #include <xdrpp/srpc.h>
 
@@ -27,43 +29,91 @@ fullread(sock_t s, void *buf, size_t n)
 }
 
 msg_ptr
-read_message(sock_t s)
+read_message(sock_t s, std::size_t maxmsglen)
 {
-  std::uint32_t len;
-  ssize_t n = fullread(s, &len, 4);
-  if (n == -1)
-    throw xdr_system_error("xdr::read_message");
-  if (n < 4)
-    throw xdr_bad_message_size("read_message: premature EOF");
-  if (len & 3)
-    throw xdr_bad_message_size("read_message: received size not multiple of 4");
+  msg_ptr m;
+  for (bool last = false; !last;) {
+    std::uint32_t len;
+    ssize_t n = fullread(s, &len, 4);
+    if (n == -1)
+      throw xdr_system_error("xdr::read_message");
+    if (n < 4)
+      throw xdr_bad_message_size("read_message: premature EOF");
 
-  len = swap32le(len);
-  if (len & 0x80000000)
+    len = swap32le(len);
+    last = len & 0x80000000;
     len &= 0x7fffffff;
-  else
-    throw xdr_bad_message_size("read_message: message fragments unimplemented");
 
-  msg_ptr m = message_t::alloc(len);
-  n = fullread(s, m->data(), len);
-  if (n == -1)
-    throw xdr_system_error("xdr::read_message");
-  if (n != len)
-    throw xdr_bad_message_size("read_message: premature EOF");
+    // Reassemble multi-fragment records.  A record in a single
+    // fragment is bounded by its mark, so only the total of several
+    // fragments is checked against maxmsglen.
+    std::size_t have = m ? m->size() : 0;
+    if ((m || !last) && (len > maxmsglen || have > maxmsglen - len))
+      throw xdr_bad_message_size("read_message: message too long");
+    if (m)
+      message_t::resize(m, have + len);
+    else
+      m = message_t::alloc(len);
+    n = fullread(s, m->data() + have, len);
+    if (n == -1)
+      throw xdr_system_error("xdr::read_message");
+    if (n != len)
+      throw xdr_bad_message_size("read_message: premature EOF");
+  }
+  if (m->size() & 3)
+    throw xdr_bad_message_size("read_message: received size not multiple of 4");
 
   return m;
 }
 
+// Write all of iov, continuing after short writes (Linux never
+// writes more than MAX_RW_COUNT, just under 2 GiB, in one call).
+static void
+fullwritev(sock_t s, iovec *iov, int iovcnt)
+{
+  while (iovcnt > 0) {
+    ssize_t n = writev(s, iov, iovcnt);
+    if (n == -1) {
+      if (errno == EINTR)
+	continue;
+      throw xdr_system_error("xdr::write_message");
+    }
+    // n is 0 only for a non-blocking descriptor, which is not allowed
+    // for the synchronous interface.
+    assert(n > 0);
+    for (; iovcnt > 0 && std::size_t(n) >= iov->iov_len; ++iov, --iovcnt)
+      n -= iov->iov_len;
+    if (iovcnt) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + n;
+      iov->iov_len -= n;
+    }
+  }
+}
+
 void
 write_message(sock_t s, const msg_ptr &m)
 {
-  ssize_t n = write(s, m->raw_data(), m->raw_size());
-  if (n == -1)
-    throw xdr_system_error("xdr::write_message");
-  // If this assertion fails, the file descriptor may have had
-  // O_NONBLOCK set, which is not allowed for the synchronous
-  // interface.
-  assert(std::size_t(n) == m->raw_size());
+  constexpr std::size_t max_fragsize = 0x7fffffff;
+  if (m->size() <= max_fragsize) {
+    iovec iov;
+    iov.iov_base = m->raw_data();
+    iov.iov_len = m->raw_size();
+    fullwritev(s, &iov, 1);
+    return;
+  }
+
+  // Too big for one record fragment
+  for (std::size_t pos = 0; pos < m->size();) {
+    std::size_t len = std::min(m->size() - pos, max_fragsize);
+    std::uint32_t mark = detail::record_mark(len, pos + len == m->size());
+    iovec iov[2];
+    iov[0].iov_base = &mark;
+    iov[0].iov_len = 4;
+    iov[1].iov_base = m->data() + pos;
+    iov[1].iov_len = len;
+    fullwritev(s, iov, 2);
+    pos += len;
+  }
 }
 
 uint32_t xid_counter;
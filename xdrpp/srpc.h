@@ -12,7 +12,11 @@ namespace xdr {
 
 extern bool xdr_trace_client;
 
-msg_ptr read_message(sock_t s);
+//! Read one record.  A single fragment may hold up to 2 GiB, as the
+//! record mark allows, but a record split into several fragments
+//! throws xdr_bad_message_size once it exceeds \c maxmsglen bytes.
+msg_ptr read_message(sock_t s,
+		     std::size_t maxmsglen = msg_sock::default_maxmsglen);
 void write_message(sock_t s, const msg_ptr &m);
 
 void prepare_call(uint32_t prog, uint32_t vers, uint32_t proc, rpc_msg &hdr);
@@ -180,6 +184,11 @@ template<typename Session = void,
 using srpc_tcp_listener =
   generic_rpc_tcp_listener<srpc_service, Session, SessionAllocator>;
 
+template<typename Session = void,
+	 typename SessionAllocator = session_allocator<Session>>
+using srpc_tcp_group =
+  generic_rpc_tcp_group<srpc_service, Session, SessionAllocator>;
+
 }
 
 #endif // !_XDRPP_SRPC_H_HEADER_INCLUDED_
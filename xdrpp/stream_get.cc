@@ -0,0 +1,141 @@
+
+#include <cassert>
+#include <new>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <xdrpp/stream_get.h>
+
+namespace xdr {
+namespace detail {
+
+namespace {
+// Thrown out of yield to unwind a function whose resumable is being
+// destroyed.
+struct resumable_cancel {};
+
+std::size_t
+page_size()
+{
+  static const std::size_t sz = sysconf(_SC_PAGESIZE);
+  return sz;
+}
+}
+
+struct resumable::impl {
+  ucontext_t caller;
+  ucontext_t self;
+  char *stack {nullptr};
+  std::size_t map_size {0};	// Including guard page
+  std::function<void()> body;
+  std::exception_ptr err;
+  bool active {false};
+  bool cancel {false};
+};
+
+// makecontext can only portably pass int arguments, so the function
+// being started is handed over in a thread-local variable.
+static thread_local void *starting;
+
+resumable::resumable(std::size_t stack_size)
+  : impl_(new impl)
+{
+  std::size_t pg = page_size();
+  impl_->map_size = (stack_size + 2*pg - 1) & ~(pg - 1);
+  void *p = mmap(nullptr, impl_->map_size, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::bad_alloc();
+  impl_->stack = static_cast<char *>(p);
+  // The stack grows down, so the guard page goes at the bottom
+  mprotect(impl_->stack, pg, PROT_NONE);
+}
+
+resumable::~resumable()
+{
+  cancel();
+  munmap(impl_->stack, impl_->map_size);
+}
+
+void
+resumable::cancel()
+{
+  if (impl_->active) {
+    impl_->cancel = true;
+    swapcontext(&impl_->caller, &impl_->self);
+    assert(!impl_->active);
+    impl_->cancel = false;
+    impl_->err = nullptr;
+  }
+}
+
+std::size_t
+resumable::stack_size() const
+{
+  return impl_->map_size - page_size();
+}
+
+void
+resumable::trampoline()
+{
+  impl *r = static_cast<impl *>(starting);
+  try {
+    r->body();
+  }
+  catch (const resumable_cancel &) {}
+  catch (...) {
+    r->err = std::current_exception();
+  }
+  r->active = false;
+  // Returning resumes r->caller through uc_link
+}
+
+void
+resumable::switch_in()
+{
+  swapcontext(&impl_->caller, &impl_->self);
+  if (impl_->err) {
+    std::exception_ptr err = std::move(impl_->err);
+    impl_->err = nullptr;
+    std::rethrow_exception(err);
+  }
+}
+
+void
+resumable::start(std::function<void()> f)
+{
+  assert(!impl_->active);
+  impl_->body = std::move(f);
+  getcontext(&impl_->self);
+  impl_->self.uc_stack.ss_sp = impl_->stack + page_size();
+  impl_->self.uc_stack.ss_size = stack_size();
+  impl_->self.uc_link = &impl_->caller;
+  makecontext(&impl_->self, trampoline, 0);
+  impl_->active = true;
+  starting = impl_.get();
+  switch_in();
+}
+
+void
+resumable::resume()
+{
+  assert(impl_->active);
+  switch_in();
+}
+
+void
+resumable::yield()
+{
+  swapcontext(&impl_->self, &impl_->caller);
+  if (impl_->cancel)
+    throw resumable_cancel();
+}
+
+bool
+resumable::active() const
+{
+  return impl_->active;
+}
+
+} // namespace detail
+} // namespace xdr
@@ -0,0 +1,325 @@
+// -*- C++ -*-
+
+/** \file stream_get.h Incremental unmarshaling.  Rather than waiting
+ * for a whole record to arrive in an xdr::message_t,
+ * xdr::xdr_stream_decoder consumes each chunk of bytes as it is read
+ * from the network (see xdr::msg_sock::setscb), building the target
+ * object as it goes and suspending whenever it runs out of input.
+ * Peak memory is therefore bounded by the object being built, not by
+ * the size of the marshaled record.
+ */
+
+#ifndef _XDRPP_STREAM_GET_H_HEADER_INCLUDED_
+#define _XDRPP_STREAM_GET_H_HEADER_INCLUDED_ 1
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <xdrpp/marshal.h>
+
+namespace xdr {
+
+namespace detail {
+//! A function running on its own stack, which can suspend itself
+//! with \c yield and be continued with \c resume.  This is what lets
+//! the ordinary recursive marshaling code stop in the middle of a
+//! data structure when the input runs dry.  The stack is reserved
+//! with \c mmap and only touched pages consume memory; a guard page
+//! turns overflow into a fault rather than silent corruption.
+class resumable {
+  struct impl;
+  std::unique_ptr<impl> impl_;
+  static void trampoline();
+  void switch_in();
+
+public:
+  static constexpr std::size_t default_stack_size = 0x800000;
+
+  explicit resumable(std::size_t stack_size = default_stack_size);
+  ~resumable();
+  resumable(const resumable &) = delete;
+  resumable &operator=(const resumable &) = delete;
+
+  //! Bytes of usable stack.
+  std::size_t stack_size() const;
+  //! Run \c f on the private stack until it returns or calls \c
+  //! yield.  Exceptions thrown by \c f propagate out of \c start or
+  //! \c resume.
+  void start(std::function<void()> f);
+  //! Continue a function suspended in \c yield.
+  void resume();
+  //! Called from within the function to return control to whoever
+  //! called \c start or \c resume.  If the \c resumable is destroyed
+  //! while suspended, \c yield throws an exception that is not
+  //! derived from \c std::exception, so as to unwind the stack.
+  void yield();
+  //! True between \c start and the function returning.
+  bool active() const;
+  //! Unwind a suspended function now, as destruction would, so that
+  //! objects it uses may then be destroyed.  Does nothing if the
+  //! function is not active.
+  void cancel();
+};
+} // namespace detail
+
+//! Archive that unmarshals from a sequence of byte chunks fed to it
+//! from outside, calling \c detail::resumable::yield when it needs
+//! more input.  Variable-length vectors, strings, and opaques grow as
+//! their bytes arrive, so a bogus length cannot force a large
+//! allocation.  When the current chunk holds all of a fixed-size
+//! value (or a run of numbers) and is 4-byte aligned, that part is
+//! decoded by an unchecked xdr::xdr_generic_get.  Views such as
+//! xdr::opaque_view cannot be unmarshaled this way, as no buffer
+//! outlives the chunk.
+template<typename Base> struct xdr_generic_stream_get : Base {
+  using Base::get32;
+  using Base::get64;
+  using Base::get32_block;
+  using Base::get64_block;
+
+  detail::resumable &co_;
+  const char *p_ {nullptr};
+  const char *e_ {nullptr};
+  //! The current chunk ends the record.
+  bool eor_ {false};
+  //! When set, vector elements and optional values that a record
+  //! does not use are kept here for reuse rather than destroyed.
+  reuse_cache *reuse_ {nullptr};
+
+  explicit xdr_generic_stream_get(detail::resumable &co) : co_(co) {}
+
+  std::size_t avail() const { return e_ - p_; }
+
+  //! Wait until at least one byte of input is available.
+  void more() {
+    while (p_ == e_) {
+      if (eor_)
+	throw xdr_overflow("premature end of record in xdr_stream_get");
+      co_.yield();
+    }
+  }
+
+  //! Copy \c n bytes of input to \c buf, waiting for them as needed.
+  void read(void *buf, std::size_t n) {
+    char *d = static_cast<char *>(buf);
+    while (n) {
+      more();
+      std::size_t k = std::min(n, avail());
+      std::memcpy(d, p_, k);
+      p_ += k;
+      d += k;
+      n -= k;
+    }
+  }
+
+  template<typename T> typename std::enable_if<
+    std::is_same<std::uint32_t, typename xdr_traits<T>::uint_type>::value>::type
+  operator()(T &t) {
+    std::uint32_t w;
+    read(&w, 4);
+    const std::uint32_t *p = &w;
+    t = xdr_traits<T>::from_uint(get32(p));
+    if constexpr (xdr_traits<T>::is_enum)
+      validate_enum<T>::validate(t);
+  }
+
+  template<typename T> typename std::enable_if<
+    std::is_same<std::uint64_t, typename xdr_traits<T>::uint_type>::value>::type
+  operator()(T &t) {
+    std::uint32_t w[2];
+    read(w, 8);
+    const std::uint32_t *p = w;
+    t = xdr_traits<T>::from_uint(get64(p));
+  }
+
+  template<typename T> typename std::enable_if<xdr_traits<T>::is_bytes>::type
+  operator()(T &t) {
+    static_assert(!detail::is_bytes_view<T>::value,
+		  "views cannot be unmarshaled incrementally");
+    std::size_t n;
+    if (xdr_traits<T>::variable_nelem) {
+      std::uint32_t size;
+      archive(*this, size);
+      t.check_size(size);
+      n = size;
+      for (std::size_t have = 0; have < n;) {
+	more();
+	std::size_t k = std::min(n - have, avail());
+	t.resize(have + k);
+	std::memcpy(t.data() + have, p_, k);
+	p_ += k;
+	have += k;
+      }
+      if (!n)
+	t.resize(0);
+    }
+    else {
+      n = t.size();
+      read(t.data(), n);
+    }
+    if (n & 3) {
+      std::uint32_t pad = 0;
+      read(&pad, 4 - (n & 3));
+      if (pad)
+	throw xdr_should_be_zero("Non-zero padding bytes encountered");
+    }
+  }
+
+  template<typename T> typename std::enable_if<
+    xdr_traits<T>::is_class || xdr_traits<T>::is_container>::type
+  operator()(T &t) {
+    if (!marshal_base::stack_limit--)
+      throw xdr_stack_overflow("stack overflow in xdr_stream_get");
+    if constexpr (xdr_traits<T>::has_fixed_size) {
+      if (avail() >= xdr_traits<T>::fixed_size && aligned())
+	get_unchecked(t, xdr_traits<T>::fixed_size);
+      else
+	xdr_traits<T>::load(*this, t);
+    }
+    else if constexpr (detail::is_numeric_block<T>::value)
+      get_numeric_block(t);
+    else
+      xdr_traits<T>::load(*this, t);
+    ++marshal_base::stack_limit;
+  }
+
+  //! Unmarshal a vector or array of numbers, converting whatever
+  //! aligned whole elements each chunk holds in bulk.
+  template<typename T> void get_numeric_block(T &t) {
+    using value_type = typename T::value_type;
+    constexpr std::size_t vsize = xdr_traits<value_type>::fixed_size;
+    std::uint32_t n;
+    if (xdr_traits<T>::variable_nelem) {
+      archive(*this, n);
+      t.check_size(n);
+      if (t.size() > n)
+	t.resize(n);
+    }
+    else
+      n = size32(t.size());
+    for (std::uint32_t i = 0; i < n;) {
+      more();
+      std::size_t k = std::min<std::size_t>(n - i, avail() / vsize);
+      if (k && aligned()) {
+	if (t.size() < i + k)
+	  t.resize(i + k);
+	const std::uint32_t *p = reinterpret_cast<const std::uint32_t *>(p_);
+	if constexpr (vsize == 4)
+	  get32_block(p, t.data() + i, k);
+	else
+	  get64_block(p, t.data() + i, k);
+	p_ += k * vsize;
+	i += k;
+      }
+      else {
+	if (t.size() <= i)
+	  t.resize(i + 1);
+	archive(*this, t[i++]);
+      }
+    }
+  }
+
+private:
+  bool aligned() const { return !(reinterpret_cast<std::uintptr_t>(p_) & 3); }
+
+  template<typename T> void get_unchecked(T &t, std::size_t n) {
+    xdr_generic_get<Base, false> u(p_, p_ + n);
+    u.stack_limit = marshal_base::stack_limit;
+    u.load_contents(t);
+    p_ = reinterpret_cast<const char *>(u.p_);
+  }
+};
+
+#if XDRPP_WORDS_BIGENDIAN
+using xdr_stream_get = xdr_generic_stream_get<marshal_noswap>;
+#else // !XDRPP_WORDS_BIGENDIAN
+//! Incremental archive for unmarshaling in RFC4506 big-endian order.
+using xdr_stream_get = xdr_generic_stream_get<marshal_swap>;
+#endif // !XDRPP_WORDS_BIGENDIAN
+
+//! Unmarshal a stream of records, each holding one value of type \c
+//! T, from chunks of bytes as they arrive.  Each record is decoded
+//! into the same object, which is reused from one record to the next
+//! (so long-lived buffers keep their capacity).  The signature of \c
+//! feed matches xdr::msg_sock::scb_t, so a typical use is:
+//! \code
+//!   xdr_stream_decoder<T> d(t);
+//!   ms.setscb([&](const char *p, std::size_t n, bool eor) {
+//!     if (!p) { /* EOF or error */ }
+//!     else if (d.feed(p, n, eor)) { /* use t */ }
+//!   });
+//! \endcode
+template<typename T> class xdr_stream_decoder {
+  T &t_;
+  detail::resumable co_;
+  xdr_stream_get ar_;
+  std::uint32_t stack_limit_;
+  bool finished_ {false};	// Value decoded, waiting for end of record
+  bool skipping_ {false};	// Discarding the rest of a bad record
+
+  void fail(bool eor) {
+    finished_ = false;
+    skipping_ = !eor;
+  }
+
+public:
+  //! Decode into \c t.  The depth of nesting is limited both by
+  //! xdr::marshaling_stack_limit and by the size of the private
+  //! stack, allowing about 2 KiB of stack per level.
+  explicit xdr_stream_decoder(T &t, std::size_t stack_size
+			      = detail::resumable::default_stack_size)
+    : t_(t), co_(stack_size), ar_(co_),
+      stack_limit_(std::min<std::size_t>(marshaling_stack_limit,
+					 co_.stack_size() / 2048)) {}
+  // A suspended decode runs inside ar_, so unwind it before ar_ goes
+  ~xdr_stream_decoder() { co_.cancel(); }
+
+  //! Set to keep unused elements for later records.
+  void set_reuse_cache(reuse_cache *c) { ar_.reuse_ = c; }
+
+  //! Consume \c n bytes of input, where \c eor indicates the bytes
+  //! end a record.  Returns \c true when a complete record has been
+  //! decoded into the target object.  Throws if the record is
+  //! malformed, in which case the remainder of the record is
+  //! discarded by subsequent calls.  The bytes need not stay valid
+  //! after \c feed returns.
+  bool feed(const void *data, std::size_t n, bool eor) {
+    if (skipping_) {
+      skipping_ = !eor;
+      return false;
+    }
+    ar_.p_ = static_cast<const char *>(data);
+    ar_.e_ = ar_.p_ + n;
+    ar_.eor_ = eor;
+    if (!finished_) {
+      try {
+	if (co_.active())
+	  co_.resume();
+	else
+	  co_.start([this]() {
+	      ar_.stack_limit = stack_limit_;
+	      archive(ar_, t_);
+	    });
+      }
+      catch (...) {
+	fail(eor);
+	throw;
+      }
+      if (co_.active())
+	return false;
+      finished_ = true;
+    }
+    if (ar_.p_ != ar_.e_) {
+      fail(eor);
+      throw xdr_bad_message_size("xdr_stream_decoder: record too long");
+    }
+    if (!eor)
+      return false;
+    finished_ = false;
+    return true;
+  }
+};
+
+}
+
+#endif // !_XDRPP_STREAM_GET_H_HEADER_INCLUDED_
@@ -0,0 +1,135 @@
+
+#include <algorithm>
+#include <xdrpp/thread_pool.h>
+
+namespace xdr {
+
+namespace {
+// The pool and index of the worker running on this thread, if any
+thread_local const thread_pool *current_pool;
+thread_local std::size_t current_worker;
+}
+
+thread_pool::thread_pool(std::size_t nthreads)
+{
+  if (!nthreads)
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t i = 0; i < nthreads; i++)
+    workers_.emplace_back(new worker);
+  for (std::size_t i = 0; i < nthreads; i++)
+    workers_[i]->thread_ = std::thread(&thread_pool::run, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+  {
+    std::lock_guard<std::mutex> lk(idle_lock_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto &w : workers_)
+    w->thread_.join();
+}
+
+void
+thread_pool::submit(task_t t)
+{
+  std::size_t i = current_pool == this ? current_worker
+    : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+  std::size_t n;
+  {
+    // Count the task before a worker can pop it, so queued_ never
+    // drops below zero.
+    std::lock_guard<std::mutex> lk(workers_[i]->lock_);
+    n = ++queued_;
+    workers_[i]->q_.push_back(std::move(t));
+  }
+  for (std::size_t m = max_queued_.load(std::memory_order_relaxed);
+       n > m && !max_queued_.compare_exchange_weak(m, n,
+						   std::memory_order_relaxed);)
+    ;
+  // A worker going idle increments nidle_ before checking queued_,
+  // so either it sees the task or we see it and wake it.
+  if (nidle_) {
+    { std::lock_guard<std::mutex> lk(idle_lock_); }
+    cv_.notify_one();
+  }
+}
+
+bool
+thread_pool::pop(std::size_t i, task_t &t)
+{
+  if (!queued_)
+    return false;
+  const std::size_t n = workers_.size();
+  for (std::size_t j = 0; j < n; j++) {
+    worker &w = *workers_[(i + j) % n];
+    std::lock_guard<std::mutex> lk(w.lock_);
+    if (w.q_.empty())
+      continue;
+    if (j == 0) {
+      t = std::move(w.q_.front());
+      w.q_.pop_front();
+    }
+    else {
+      t = std::move(w.q_.back());
+      w.q_.pop_back();
+      stolen_.fetch_add(1, std::memory_order_relaxed);
+    }
+    --queued_;
+    return true;
+  }
+  return false;
+}
+
+void
+thread_pool::run(std::size_t i)
+{
+  current_pool = this;
+  current_worker = i;
+  for (task_t t;;) {
+    if (pop(i, t)) {
+      ++running_;
+      t();
+      t = nullptr;
+      --running_;
+      completed_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    std::unique_lock<std::mutex> lk(idle_lock_);
+    ++nidle_;
+    cv_.wait(lk, [this]() { return stop_ || queued_; });
+    --nidle_;
+    if (stop_ && !queued_)
+      return;
+  }
+}
+
+std::size_t
+thread_pool::depth(std::size_t i)
+{
+  worker &w = *workers_.at(i);
+  std::lock_guard<std::mutex> lk(w.lock_);
+  return w.q_.size();
+}
+
+thread_pool_stats
+thread_pool::stats() const
+{
+  return { workers_.size(), queued_, max_queued_, running_,
+	   completed_.load(std::memory_order_relaxed),
+	   stolen_.load(std::memory_order_relaxed) };
+}
+
+std::shared_ptr<thread_pool>
+thread_pool::shared()
+{
+  // Never destroyed, so that exit does not wait for a blocked task
+  static std::shared_ptr<thread_pool> *pool =
+    new std::shared_ptr<thread_pool>(std::make_shared<thread_pool>(
+      std::max<std::size_t>(shared_min_threads,
+			    std::thread::hardware_concurrency())));
+  return *pool;
+}
+
+}
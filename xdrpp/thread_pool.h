@@ -0,0 +1,98 @@
+// -*- C++ -*-
+
+/** \file thread_pool.h Worker threads for blocking work.  A fixed
+ * number of workers each take tasks from their own queue, and steal
+ * from the others' when theirs runs dry.  xdr::pollset_plus::async
+ * runs its work on one of these.
+ */
+
+#ifndef _XDRPP_THREAD_POOL_H_HEADER_INCLUDED_
+#define _XDRPP_THREAD_POOL_H_HEADER_INCLUDED_ 1
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xdr {
+
+//! Counts of a thread pool's work.
+struct thread_pool_stats {
+  std::size_t threads;		//!< Number of workers
+  std::size_t queued;		//!< Tasks waiting for a worker
+  std::size_t max_queued;	//!< Most tasks ever waiting at once
+  std::size_t running;		//!< Tasks currently executing
+  std::uint64_t completed;	//!< Tasks finished
+  std::uint64_t stolen;		//!< Tasks run by a worker they were not
+				//!< queued for
+};
+
+//! A fixed set of worker threads.  Tasks submitted from outside the
+//! pool are dealt to the workers' queues in turn, while tasks
+//! submitted by a task go to its own worker's queue.  Workers run
+//! their own queue oldest first and, when it is empty, steal the
+//! newest task from another queue.  Queues are unbounded.  Tasks must
+//! not throw.  All methods are thread-safe.
+class thread_pool {
+public:
+  using task_t = std::function<void()>;
+
+private:
+  struct worker {
+    std::mutex lock_;
+    std::deque<task_t> q_;
+    std::thread thread_;
+  };
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::atomic<std::size_t> next_ {0};
+
+  std::atomic<std::size_t> queued_ {0};
+  std::atomic<std::size_t> max_queued_ {0};
+  std::atomic<std::size_t> running_ {0};
+  std::atomic<std::uint64_t> completed_ {0};
+  std::atomic<std::uint64_t> stolen_ {0};
+
+  // Idle workers sleep on cv_
+  std::mutex idle_lock_;
+  std::condition_variable cv_;
+  std::atomic<std::size_t> nidle_ {0};
+  bool stop_ {false};
+
+  bool pop(std::size_t i, task_t &t);
+  void run(std::size_t i);
+
+public:
+  //! Zero \c nthreads means one per hardware thread.
+  explicit thread_pool(std::size_t nthreads = 0);
+  //! Runs every task already submitted, then joins the workers.
+  ~thread_pool();
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  void submit(task_t t);
+
+  std::size_t size() const { return workers_.size(); }
+  //! Tasks waiting in the queue of worker \c i.
+  std::size_t depth(std::size_t i);
+  thread_pool_stats stats() const;
+
+  //! Least number of workers in the pool returned by \c shared.
+  static constexpr std::size_t shared_min_threads = 4;
+
+  //! The pool used by every xdr::pollset_plus not given another one,
+  //! created on first use with one worker per hardware thread, but at
+  //! least \c shared_min_threads.  Every task blocked in a system call
+  //! or synchronous RPC holds a worker, so a program with more
+  //! blocking work than that should give its pollsets a larger pool.
+  //! The pool is never destroyed, so its workers do not delay exit.
+  static std::shared_ptr<thread_pool> shared();
+};
+
+}
+
+#endif // !_XDRPP_THREAD_POOL_H_HEADER_INCLUDED_
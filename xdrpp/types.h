@@ -5,15 +5,20 @@
 #ifndef _XDRC_TYPES_H_HEADER_INCLUDED_
 #define _XDRC_TYPES_H_HEADER_INCLUDED_ 1
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <compare>
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <memory_resource>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
+#include <typeindex>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 #include <limits>
@@ -163,9 +168,12 @@ private:
   decltype(xdr_validate_enum(U{}), std::true_type{}) test(int);
 
 public:
+  //! True if values must be checked against the enum's tags.
+  static Constexpr const bool enabled = decltype(test<T>(0))::value;
+
   static void validate(T t)
   {
-    if constexpr (decltype(test<T>(0))::value) {
+    if constexpr (enabled) {
       if (!xdr_traits<T>::enum_name(t))
 	throw xdr_invariant_failed("Invalid enum value");
     }
@@ -359,7 +367,37 @@ template<> struct xdr_traits<bool>
 //! in 32 bits when rounded up to a multiple of four.)
 static Constexpr const uint32_t XDR_MAX_LEN = 0xfffffffc;
 
+class reuse_cache;
+
 namespace detail {
+//! True for archives with a \c reuse_ member (pointer to
+//! xdr::reuse_cache), which may keep container elements alive across
+//! loads instead of destroying them.
+template<typename A, typename = void> struct archive_reuse : std::false_type {};
+template<typename A> struct archive_reuse<
+  A, std::void_t<decltype(std::declval<A &>().reuse_)>> : std::true_type {};
+
+//! Shrink container \c t to \c n elements before loading.
+template<typename Archive, typename T> inline void
+load_shrink(Archive &a, T &t, uint32_t n)
+{
+  if constexpr (archive_reuse<Archive>::value)
+    if (a.reuse_)
+      return a.reuse_->shrink(t, n);
+  t.resize(n);
+}
+
+//! Return element \c i of container \c t for loading, creating it
+//! if \c i is one past the end.
+template<typename Archive, typename T> inline auto &
+load_extend_at(Archive &a, T &t, uint32_t i)
+{
+  if constexpr (archive_reuse<Archive>::value)
+    if (a.reuse_)
+      return a.reuse_->extend_at(t, i);
+  return t.extend_at(i);
+}
+
 //! Convenience supertype for traits of the three container types
 //! (xarray, xvectors, and pointer).
 template<typename T, bool variable,
@@ -383,12 +421,12 @@ struct xdr_container_base : xdr_traits_base {
       archive(a, n);
       t.check_size(n);
       if (t.size() > n)
-	t.resize(n);
+	load_shrink(a, t, n);
     }
     else
       n = size32(t.size());
     for (uint32_t i = 0; i < n; ++i)
-      archive(a, t.extend_at(i));
+      archive(a, load_extend_at(a, t, i));
   }
   static std::size_t serial_size(const T &t) {
     std::size_t s = variable ? 4 : 0;
@@ -587,6 +625,121 @@ template<uint32_t N> struct xdr_traits<xstring<N>> : xdr_traits_base {
 };
 
 
+namespace detail {
+//! Common implementation of xdr::opaque_view and xdr::xstring_view.
+template<typename CharT, uint32_t N> class bytes_view_base {
+  const CharT *data_ {nullptr};
+  std::size_t size_ {0};
+  std::shared_ptr<const void> owner_;
+
+public:
+  using value_type = CharT;
+  using size_type = std::size_t;
+  using const_iterator = const CharT *;
+
+  bytes_view_base() = default;
+  bytes_view_base(const CharT *data, std::size_t size,
+		  std::shared_ptr<const void> owner = nullptr)
+    : data_(data), size_(size), owner_(std::move(owner)) {}
+
+  //! Return the maximum size allowed by the type.
+  static Constexpr uint32_t max_size() { return N; }
+  //! Check whether a size is in bounds
+  static void check_size(std::size_t n) {
+    if (n > max_size())
+      throw xdr_overflow("xdr view overflow");
+  }
+
+  const CharT *data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return !size_; }
+  const CharT *begin() const { return data_; }
+  const CharT *end() const { return data_ + size_; }
+  const CharT &operator[](std::size_t i) const { return data_[i]; }
+  //! The object keeping the viewed bytes alive, if any.
+  const std::shared_ptr<const void> &owner() const { return owner_; }
+
+  //! Views can only shrink; this is mostly for \c xdr::xdr_clear.
+  void resize(std::size_t n) {
+    if (n > size_)
+      throw xdr_overflow("cannot grow an xdr view");
+    size_ = n;
+    if (!n)
+      owner_.reset();
+  }
+
+  friend bool operator==(const bytes_view_base &a, const bytes_view_base &b) {
+    return a.size_ == b.size_ && !(a.size_ && std::memcmp(a.data_, b.data_,
+							   a.size_));
+  }
+  friend std::strong_ordering operator<=>(const bytes_view_base &a,
+					  const bytes_view_base &b) {
+    std::size_t n = a.size_ < b.size_ ? a.size_ : b.size_;
+    if (n)
+      if (int c = std::memcmp(a.data_, b.data_, n))
+	return c < 0 ? std::strong_ordering::less
+	             : std::strong_ordering::greater;
+    return a.size_ <=> b.size_;
+  }
+};
+
+template<typename T> struct is_bytes_view : std::false_type {};
+} // namespace detail
+
+//! A read-only, zero-copy stand-in for \c opaque_vec that points into
+//! the buffer it was unmarshaled from rather than copying the bytes.
+//! When unmarshaled from an xdr::shared_msg_ptr, the view shares
+//! ownership of the message, so the bytes remain valid for the
+//! lifetime of the view.  When unmarshaled from a raw buffer or
+//! xdr::msg_ptr, the caller must keep the buffer alive.  Views
+//! marshal exactly like \c opaque_vec.
+template<uint32_t N = XDR_MAX_LEN> struct opaque_view
+  : detail::bytes_view_base<std::uint8_t, N> {
+  using base = detail::bytes_view_base<std::uint8_t, N>;
+  using base::base;
+  opaque_view() = default;
+  opaque_view(const opaque_vec<N> &v) : base(v.data(), v.size()) {}
+
+  //! Copy the viewed bytes into a new owning vector.
+  opaque_vec<N> vec() const { return opaque_vec<N>(this->begin(), this->end()); }
+};
+
+//! A read-only, zero-copy stand-in for \c xstring.  See
+//! xdr::opaque_view for lifetime rules.
+template<uint32_t N = XDR_MAX_LEN> struct xstring_view
+  : detail::bytes_view_base<char, N> {
+  using base = detail::bytes_view_base<char, N>;
+  using base::base;
+  xstring_view() = default;
+  xstring_view(const xstring<N> &s) : base(s.data(), s.size()) {}
+
+  operator std::string_view() const {
+    return std::string_view(this->data(), this->size());
+  }
+  //! Copy the viewed bytes into a new owning string.
+  xstring<N> str() const { return xstring<N>(this->data(), this->size()); }
+};
+
+namespace detail {
+template<uint32_t N> struct is_bytes_view<opaque_view<N>> : std::true_type {};
+template<uint32_t N> struct is_bytes_view<xstring_view<N>> : std::true_type {};
+
+template<typename T> struct xdr_bytes_view_base : xdr_traits_base {
+  static Constexpr const bool is_bytes = true;
+  static Constexpr const bool has_fixed_size = false;
+  static Constexpr std::size_t serial_size(const T &a) {
+    return (std::size_t(a.size()) + std::size_t(7)) & ~std::size_t(3);
+  }
+  static Constexpr const bool variable_nelem = true;
+};
+} // namespace detail
+
+template<uint32_t N> struct xdr_traits<opaque_view<N>>
+  : detail::xdr_bytes_view_base<opaque_view<N>> {};
+template<uint32_t N> struct xdr_traits<xstring_view<N>>
+  : detail::xdr_bytes_view_base<xstring_view<N>> {};
+
+
 //! Optional data (represented with pointer notation in XDR source).
 template<typename T> struct pointer : std::unique_ptr<T> {
   using value_type = T;
@@ -665,6 +818,357 @@ template<typename T> struct xdr_traits<pointer<T>>
   : detail::xdr_container_base<pointer<T>, true, false> {};
 
 
+//! Spare objects for decoding repeatedly into the same long-lived
+//! value (see xdr::xdr_from_msg_reuse).  Ordinarily, when a message
+//! has fewer vector elements than the destination, or leaves out an
+//! optional value, unmarshaling destroys the excess objects and
+//! later messages must allocate them again.  With a \c reuse_cache,
+//! those objects (and the buffers nested inside them) are instead
+//! parked here and moved back in when a later message needs them, so
+//! that decoding a stream of similarly shaped messages into one
+//! scratch object reaches a steady state with no allocation.  Note
+//! that switching a union to a different arm still destroys the old
+//! arm.  A \c reuse_cache may be used with any number of
+//! destinations, but not concurrently from multiple threads.
+class reuse_cache {
+  struct spares_base {
+    virtual ~spares_base() {}
+  };
+  template<typename T> struct spares : spares_base {
+    std::vector<T> v_;
+  };
+  std::unordered_map<std::type_index, std::unique_ptr<spares_base>> spares_;
+
+  template<typename T> std::vector<T> &get() {
+    std::unique_ptr<spares_base> &sp = spares_[typeid(T)];
+    if (!sp)
+      sp.reset(new spares<T>);
+    return static_cast<spares<T> *>(sp.get())->v_;
+  }
+
+public:
+  //! Release all spare objects.
+  void clear() { spares_.clear(); }
+
+  template<typename C> void shrink(C &c, uint32_t n) { c.resize(n); }
+  template<typename C> auto &extend_at(C &c, uint32_t i) {
+    return c.extend_at(i);
+  }
+
+  template<typename T, uint32_t N> void shrink(xvector<T,N> &v, uint32_t n) {
+    if (v.size() <= n)
+      return v.resize(n);
+    std::vector<T> &sv = get<T>();
+    for (std::size_t i = v.size(); i-- > n;)
+      sv.push_back(std::move(v[i]));
+    v.resize(n);
+  }
+  template<typename T, uint32_t N> T &extend_at(xvector<T,N> &v, uint32_t i) {
+    if (i == v.size() && i < N) {
+      std::vector<T> &sv = get<T>();
+      if (!sv.empty()) {
+	v.push_back(std::move(sv.back()));
+	sv.pop_back();
+      }
+    }
+    return v.extend_at(i);
+  }
+
+  template<typename T> void shrink(pointer<T> &p, uint32_t n) {
+    if (n == 0 && p)
+      get<std::unique_ptr<T>>().push_back(std::move(p));
+    p.resize(n);
+  }
+  template<typename T> T &extend_at(pointer<T> &p, uint32_t i) {
+    if (i == 0 && !p) {
+      std::vector<std::unique_ptr<T>> &sv = get<std::unique_ptr<T>>();
+      if (!sv.empty()) {
+	p.reset(sv.back().release());
+	sv.pop_back();
+      }
+    }
+    return p.extend_at(i);
+  }
+};
+
+
+////////////////////////////////////////////////////////////////
+// Allocator-aware containers (xdrc -pmr)
+////////////////////////////////////////////////////////////////
+
+//! Variants of xdr::xvector, xdr::xstring, xdr::opaque_vec, and
+//! xdr::pointer that allocate from a \c std::pmr::memory_resource.
+//! These are what \c xdrc \c -pmr emits.  A default-constructed
+//! container draws from the calling thread's \c current_resource(),
+//! and elements created inside a container use the container's
+//! resource, so an entire request can be decoded into an arena:
+//!
+//! \code
+//!   std::pmr::monotonic_buffer_resource arena;
+//!   xdr::pmr::resource_scope scope(&arena);
+//!   auto *req = new (arena.allocate(sizeof(T), alignof(T))) T;
+//!   xdr::xdr_from_msg(m, *req);
+//!   // ... use *req, then skip its destructor and free everything
+//!   // in O(1) with arena.release()
+//! \endcode
+namespace pmr {
+
+inline std::pmr::memory_resource *&
+current_resource_ref()
+{
+  static thread_local std::pmr::memory_resource *r =
+    std::pmr::new_delete_resource();
+  return r;
+}
+
+//! Resource used by allocator-aware XDR containers constructed on
+//! this thread (\c std::pmr::new_delete_resource() by default).
+inline std::pmr::memory_resource *
+current_resource()
+{
+  return current_resource_ref();
+}
+
+//! Sets xdr::pmr::current_resource() for the lifetime of the object.
+class resource_scope {
+  std::pmr::memory_resource *const prev_;
+public:
+  explicit resource_scope(std::pmr::memory_resource *r)
+    : prev_(current_resource_ref()) { current_resource_ref() = r; }
+  resource_scope(const resource_scope &) = delete;
+  resource_scope &operator=(const resource_scope &) = delete;
+  ~resource_scope() { current_resource_ref() = prev_; }
+};
+
+//! Allocator-aware xdr::xvector.
+template<typename T, uint32_t N = XDR_MAX_LEN>
+struct xvector : std::pmr::vector<T> {
+  using vector = std::pmr::vector<T>;
+  using vector::vector;
+
+  xvector() : vector(current_resource()) {}
+  xvector(const xvector &v) : vector(v, current_resource()) {}
+  xvector(xvector &&) = default;
+  xvector &operator=(const xvector &) = default;
+  xvector &operator=(xvector &&) = default;
+
+  //! Return the maximum size allowed by the type.
+  static Constexpr uint32_t max_size() { return N; }
+
+  //! Check whether a size is in bounds
+  static void check_size(size_t n) {
+    if (n > max_size())
+      throw xdr_overflow("xvector overflow");
+  }
+
+  void append(const T *elems, std::size_t n) {
+    check_size(this->size() + n);
+    this->insert(this->end(), elems, elems + n);
+  }
+  T &extend_at(uint32_t i) {
+    if (i >= N)
+      throw xdr_overflow("attempt to access invalid position in xdr::xvector");
+    if (i == this->size())
+      this->emplace_back();
+    return (*this)[i];
+  }
+  void resize(uint32_t n) {
+    check_size(n);
+    vector::resize(n);
+  }
+};
+
+//! Allocator-aware xdr::opaque_vec.
+template<uint32_t N = XDR_MAX_LEN> using opaque_vec = xvector<std::uint8_t, N>;
+
+//! Allocator-aware xdr::xstring.
+template<uint32_t N = XDR_MAX_LEN> struct xstring : std::pmr::string {
+  using string = std::pmr::string;
+
+  //! Return the maximum size allowed by the type.
+  static Constexpr uint32_t max_size() { return N; }
+
+  //! Check whether a size is in bounds
+  static void check_size(size_t n) {
+    if (n > max_size())
+      throw xdr_overflow("xstring overflow");
+  }
+
+  void validate() const { check_size(size()); }
+
+  xstring() : string(current_resource()) {}
+  xstring(const xstring &s) : string(s, current_resource()) {}
+  xstring(xstring &&) = default;
+  xstring &operator=(const xstring &) = default;
+  xstring &operator=(xstring &&) = default;
+
+  template<typename...Args> xstring(Args&&...args)
+    : string(std::forward<Args>(args)...) { validate(); }
+
+  using string::data;
+  char *data() { return &(*this)[0]; }
+
+//! \hideinitializer
+#define ASSIGN_LIKE(method)					\
+  template<typename...Args> xstring &method(Args&&...args) {	\
+    string::method(std::forward<Args>(args)...);		\
+    validate();							\
+    return *this;						\
+  }
+  ASSIGN_LIKE(operator=)
+  ASSIGN_LIKE(operator+=)
+  ASSIGN_LIKE(append)
+  ASSIGN_LIKE(push_back)
+  ASSIGN_LIKE(assign)
+  ASSIGN_LIKE(insert)
+  ASSIGN_LIKE(replace)
+  ASSIGN_LIKE(swap)
+#undef ASSIGN_LIKE
+
+  void resize(size_type n) { check_size(n); string::resize(n); }
+  void resize(size_type n, char ch) { check_size(n); string::resize(n, ch); }
+};
+
+//! Allocator-aware xdr::pointer.  The object is allocated from the
+//! resource that was current when the pointer was constructed, and is
+//! itself constructed with that resource current.
+template<typename T> class pointer {
+  T *p_ {nullptr};
+  std::pmr::memory_resource *mr_;
+
+  template<typename...Args> T *make(Args &&...args) {
+    resource_scope scope(mr_);
+    void *raw = mr_->allocate(sizeof(T), alignof(T));
+    try { return new (raw) T(std::forward<Args>(args)...); }
+    catch (...) {
+      mr_->deallocate(raw, sizeof(T), alignof(T));
+      throw;
+    }
+  }
+
+public:
+  using value_type = T;
+
+  pointer() : mr_(current_resource()) {}
+  pointer(std::nullptr_t) : pointer() {}
+  pointer(const pointer &p) : mr_(current_resource()) {
+    if (p)
+      p_ = make(*p);
+  }
+  pointer(pointer &&p) noexcept : p_(p.p_), mr_(p.mr_) { p.p_ = nullptr; }
+  ~pointer() { reset(); }
+  pointer &operator=(const pointer &up) {
+    if (const T *tp = up.get()) {
+      if (p_)
+	*p_ = *tp;
+      else
+	p_ = make(*tp);
+    }
+    else
+      reset();
+    return *this;
+  }
+  pointer &operator=(pointer &&up) {
+    if (this == &up)
+      return *this;
+    if (mr_ == up.mr_ || mr_->is_equal(*up.mr_)) {
+      reset();
+      p_ = up.p_;
+      up.p_ = nullptr;
+    }
+    else {
+      *this = static_cast<const pointer &>(up);
+      up.reset();
+    }
+    return *this;
+  }
+
+  T *get() const { return p_; }
+  T &operator*() const { return *p_; }
+  T *operator->() const { return p_; }
+  explicit operator bool() const { return p_; }
+  std::pmr::memory_resource *resource() const { return mr_; }
+  void reset() {
+    if (p_) {
+      p_->~T();
+      mr_->deallocate(p_, sizeof(T), alignof(T));
+      p_ = nullptr;
+    }
+  }
+
+  static void check_size(uint32_t n) {
+    if (n > 1)
+      throw xdr_overflow("xdr::pointer size must be 0 or 1");
+  }
+  uint32_t size() const { return p_ ? 1 : 0; }
+  T *begin() const { return p_; }
+  T *end() const { return p_ + size(); }
+  T &extend_at(uint32_t i) {
+    if (i != 0)
+      throw xdr_overflow("attempt to access position > 0 in xdr::pointer");
+    if (!p_)
+      p_ = make();
+    return *p_;
+  }
+  void resize(uint32_t n) {
+    check_size(n);
+    if (!n)
+      reset();
+    else if (!p_)
+      p_ = make();
+  }
+  T &activate() {
+    if (!p_)
+      p_ = make();
+    return *p_;
+  }
+
+  //! Compare by value, rather than looking at the value of the pointer.
+  friend bool operator==(const pointer &a, const pointer &b) {
+    return (!a && !b) || (a && b && *a == *b);
+  }
+  friend detail::ordering_t operator<=>(const pointer &a, const pointer &b) {
+    if (!a)
+      return !b ? std::strong_ordering::equal : std::strong_ordering::less;
+    if (!b)
+      return std::strong_ordering::greater;
+    return *a <=> *b;
+  }
+};
+
+} // namespace pmr
+
+namespace detail {
+template<typename T> struct has_fixed_size_t<pmr::xvector<T>>
+  : std::false_type {};
+}
+
+template<typename T, uint32_t N> struct xdr_traits<pmr::xvector<T,N>>
+  : detail::xdr_container_base<pmr::xvector<T,N>, true> {};
+
+template<uint32_t N>
+struct xdr_traits<pmr::xvector<std::uint8_t, N>> : xdr_traits_base {
+  static Constexpr const bool is_bytes = true;
+  static Constexpr const bool has_fixed_size = false;;
+  static Constexpr std::size_t serial_size(const pmr::opaque_vec<N> &a) {
+    return (std::size_t(a.size()) + std::size_t(7)) & ~std::size_t(3);
+  }
+  static Constexpr const bool variable_nelem = true;
+};
+
+template<uint32_t N> struct xdr_traits<pmr::xstring<N>> : xdr_traits_base {
+  static Constexpr const bool is_bytes = true;
+  static Constexpr const bool has_fixed_size = false;;
+  static Constexpr std::size_t serial_size(const pmr::xstring<N> &a) {
+    return (std::size_t(a.size()) + std::size_t(7)) & ~std::size_t(3);
+  }
+  static Constexpr const bool variable_nelem = true;
+};
+
+template<typename T> struct xdr_traits<pmr::pointer<T>>
+  : detail::xdr_container_base<pmr::pointer<T>, true, false> {};
+
+
 ////////////////////////////////////////////////////////////////
 // Support for XDR struct types
 ////////////////////////////////////////////////////////////////
@@ -1061,6 +1565,203 @@ template<typename T> struct struct_comp_helper<T, xdr_struct_base<>> {
 };
 } // namespace detail
 
+
+////////////////////////////////////////////////////////////////
+// Hashing
+////////////////////////////////////////////////////////////////
+
+template<typename T> struct xdr_hasher;
+
+namespace detail {
+inline std::size_t
+hash_combine(std::size_t seed, std::size_t v)
+{
+  return seed ^ (v + std::size_t(0x9e3779b97f4a7c15ULL)
+		 + (seed << 6) + (seed >> 2));
+}
+
+template<typename T, typename F> struct struct_hash_helper {
+  static std::size_t hash(const T &t, std::size_t h) {
+    Constexpr const typename F::field_info fi {};
+    using field_type = typename F::field_info::field_type;
+    return struct_hash_helper<T, typename F::next_field>::hash(
+      t, hash_combine(h, xdr_hasher<field_type>{}(fi(t))));
+  }
+};
+template<typename T> struct struct_hash_helper<T, xdr_struct_base<>> {
+  static std::size_t hash(const T &, std::size_t h) { return h; }
+};
+
+struct union_field_hash_t {
+  Constexpr union_field_hash_t() {}
+  template<typename T, typename F>
+  void operator()(F T::*mp, const T &t, std::size_t &out) const {
+    out = hash_combine(out, xdr_hasher<F>{}(t.*mp));
+  }
+};
+Constexpr const union_field_hash_t union_field_hash {};
+} // namespace detail
+
+//! Hash function for XDR types, consistent with xdr::operator==.
+//! Opaque and string bodies are hashed in bulk, containers combine
+//! the hashes of their elements, structs those of their fields, and
+//! unions that of the discriminant with that of the active field.
+//! \c xdrc specializes \c std::hash to this for every struct and
+//! union it generates, so they can be used as keys of unordered
+//! containers.
+template<typename T> struct xdr_hasher {
+  std::size_t operator()(const T &t) const {
+    using traits = xdr_traits<T>;
+    if constexpr (traits::is_bytes)
+      return std::hash<std::string_view>{}(
+	std::string_view(reinterpret_cast<const char *>(t.data()), t.size()));
+    else if constexpr (traits::is_numeric || traits::is_enum)
+      return std::hash<T>{}(t);
+    else if constexpr (traits::is_union) {
+      std::size_t h = std::hash<typename traits::case_type>{}(
+	t._xdr_discriminant());
+      t._xdr_with_mem_ptr(detail::union_field_hash,
+			  t._xdr_discriminant(), t, h);
+      return h;
+    }
+    else if constexpr (traits::is_struct)
+      return detail::struct_hash_helper<T, traits>::hash(t, 0);
+    else {
+      static_assert(traits::is_container, "no hash for this type");
+      std::size_t h = t.size();
+      for (const auto &e : t)
+	h = detail::hash_combine(h, xdr_hasher<std::decay_t<decltype(e)>>{}(e));
+      return h;
+    }
+  }
+};
+
+
+
+////////////////////////////////////////////////////////////////
+// Maximum marshaled size
+////////////////////////////////////////////////////////////////
+
+namespace detail {
+template<typename T, typename = void> struct has_field_info : std::false_type {};
+template<typename T> struct has_field_info<
+  T, std::void_t<typename T::field_info>> : std::true_type {};
+
+template<typename T, typename = void>
+struct has_union_field_types : std::false_type {};
+template<typename T> struct has_union_field_types<
+  T, std::void_t<typename T::_xdr_field_types>> : std::true_type {};
+
+template<typename T> struct is_tuple : std::false_type {};
+template<typename...T> struct is_tuple<std::tuple<T...>> : std::true_type {};
+
+template<typename T> struct container_max_nelem {
+  static Constexpr const std::uint64_t value = T::max_size();
+};
+template<typename T> struct container_max_nelem<pointer<T>> {
+  static Constexpr const std::uint64_t value = 1;
+};
+
+//! Size bound of types with no limit on their marshaled size.
+Constexpr const std::uint64_t unbounded_size = ~std::uint64_t(0);
+
+Constexpr inline std::uint64_t
+bound_add(std::uint64_t a, std::uint64_t b)
+{
+  return b > unbounded_size - a ? unbounded_size : a + b;
+}
+Constexpr inline std::uint64_t
+bound_mul(std::uint64_t n, std::uint64_t b)
+{
+  return n && b > unbounded_size / n ? unbounded_size : n * b;
+}
+
+// Visiting lists the types being bounded further up the stack, so
+// that recursive types are found to be unbounded rather than
+// recursing forever.
+template<typename T, typename...Visiting> constexpr std::uint64_t
+size_bound();
+
+template<typename S, typename...Visiting> constexpr std::uint64_t
+struct_size_bound()
+{
+  if constexpr (has_field_info<S>::value)
+    return bound_add(
+      size_bound<typename S::field_info::field_type, Visiting...>(),
+      struct_size_bound<typename S::next_field, Visiting...>());
+  else
+    return 0;
+}
+
+template<typename...Visiting, typename...T> constexpr std::uint64_t
+sum_size_bound(std::tuple<T...> *)
+{
+  std::uint64_t n = 0;
+  ((n = bound_add(n, size_bound<T, Visiting...>())), ...);
+  return n;
+}
+
+template<typename...Visiting, typename...T> constexpr std::uint64_t
+max_size_bound(std::tuple<T...> *)
+{
+  std::uint64_t n = 0;
+  ((n = std::max(n, size_bound<T, Visiting...>())), ...);
+  return n;
+}
+
+template<typename T, typename...Visiting> constexpr std::uint64_t
+size_bound()
+{
+  using traits = xdr_traits<T>;
+  if constexpr ((std::is_same<T, Visiting>::value || ...))
+    return unbounded_size;
+  else if constexpr (traits::has_fixed_size)
+    return traits::fixed_size;
+  else if constexpr (traits::is_bytes)
+    return bound_add(4, (container_max_nelem<T>::value + 3) & ~std::uint64_t(3));
+  else if constexpr (traits::is_container) {
+    using V = std::decay_t<decltype(*std::declval<const T &>().begin())>;
+    if constexpr (traits::variable_nelem)
+      return bound_add(4, bound_mul(container_max_nelem<T>::value,
+				    size_bound<V, T, Visiting...>()));
+    else
+      return bound_mul(T::container_fixed_nelem,
+		       size_bound<V, T, Visiting...>());
+  }
+  else if constexpr (traits::is_struct && has_field_info<traits>::value)
+    return struct_size_bound<traits, T, Visiting...>();
+  else if constexpr (traits::is_struct && is_tuple<T>::value)
+    return sum_size_bound<T, Visiting...>(static_cast<T *>(nullptr));
+  else if constexpr (traits::is_union && has_union_field_types<T>::value)
+    return bound_add(4, max_size_bound<T, Visiting...>(
+		          static_cast<typename T::_xdr_field_types *>(nullptr)));
+  else
+    return unbounded_size;
+}
+
+template<typename T> constexpr std::size_t
+checked_max_size()
+{
+  static_assert(size_bound<T>() <= 0xffffffff,
+		"XDR type does not have a bounded size");
+  return std::size_t(size_bound<T>());
+}
+} // namespace detail
+
+//! True if every value of type \c T marshals to less than 4 GiB: all
+//! its variable-length parts have explicit bounds (as in \c
+//! xvector<T,N>, \c xstring<N>, or \c opaque_vec<N>), and it is not
+//! recursive.  Computed at compile time for structs, unions,
+//! tuples, and arrays as well as the basic types.
+template<typename T> constexpr bool xdr_has_bounded_size =
+  detail::size_bound<T>() <= 0xffffffff;
+
+//! The largest number of bytes a value of type \c T can marshal to.
+//! It is a compile-time error to use this unless
+//! xdr::xdr_has_bounded_size<T>.
+template<typename T> constexpr std::size_t xdr_max_size =
+  detail::checked_max_size<T>();
+
 } // namespace xdr
 
 #endif // !_XDRC_TYPES_H_HEADER_INCLUDED_
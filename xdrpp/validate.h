@@ -0,0 +1,263 @@
+// -*- C++ -*-
+
+/** \file validate.h Check marshaled data without unmarshaling it.
+ * xdr::xdr_validate walks the wire format of a type, applying the
+ * same checks as xdr::xdr_generic_get (bounds, size limits, zero
+ * padding, enum tags, union discriminants, and the stack limit), but
+ * constructs no objects.  Runs of plain numbers, and structs made
+ * only of them, are skipped with a single bounds check.
+ */
+
+#ifndef _XDRPP_VALIDATE_H_HEADER_INCLUDED_
+#define _XDRPP_VALIDATE_H_HEADER_INCLUDED_ 1
+
+#include <xdrpp/marshal.h>
+
+namespace xdr {
+
+namespace detail {
+template<typename T, typename = void> struct has_mem_ptr : std::false_type {};
+template<typename T> struct has_mem_ptr<
+  T, std::void_t<decltype(&T::_xdr_field_number)>> : std::true_type {};
+
+template<typename T, typename U, typename = void>
+struct has_uint_type : std::false_type {};
+template<typename T, typename U> struct has_uint_type<
+  T, U, std::void_t<typename xdr_traits<T>::uint_type>>
+  : std::is_same<U, typename xdr_traits<T>::uint_type> {};
+
+template<typename T, typename = void>
+struct has_validate_method : std::false_type {};
+template<typename T> struct has_validate_method<
+  T, std::void_t<decltype(&T::validate)>> : std::true_type {};
+
+//! True for struct traits (or the remainder of them, starting at
+//! some field) whose fields are all \c skippable.
+template<typename S, bool Strict> constexpr bool all_fields_skippable();
+
+//! True for types whose marshaled form needs no checks beyond having
+//! enough bytes: plain numbers, enums without tag validation, opaque
+//! arrays without padding, and arrays and structs of such types.
+//! Unless \c Strict, enum tags and padding are not checked anyway.
+template<typename T, bool Strict = true> constexpr bool
+skippable()
+{
+  using traits = xdr_traits<T>;
+  if constexpr (traits::is_numeric)
+    return true;
+  else if constexpr (traits::is_enum)
+    return !Strict || !validate_enum<T>::enabled;
+  else if constexpr (traits::is_bytes) {
+    if constexpr (traits::variable_nelem)
+      return false;
+    else
+      return !Strict || !(T::container_fixed_nelem & 3);
+  }
+  else if constexpr (traits::is_container) {
+    if constexpr (traits::variable_nelem)
+      return false;
+    else
+      return skippable<typename T::value_type, Strict>();
+  }
+  else if constexpr (traits::is_struct && has_field_info<traits>::value
+		     && (!Strict || !has_validate_method<T>::value))
+    return traits::has_fixed_size && all_fields_skippable<traits, Strict>();
+  else
+    return false;
+}
+
+template<typename S, bool Strict> constexpr bool
+all_fields_skippable()
+{
+  if constexpr (has_field_info<S>::value)
+    return skippable<typename S::field_info::field_type, Strict>()
+      && all_fields_skippable<typename S::next_field, Strict>();
+  else
+    return true;
+}
+
+//! Passed to \c _xdr_with_mem_ptr to validate the selected arm of a
+//! union.
+struct field_validator_t {
+  Constexpr field_validator_t() {}
+  template<typename F, typename T, typename V> void
+  operator()(F T::*, V &v) const { v.template value<F>(); }
+};
+Constexpr const field_validator_t field_validator {};
+} // namespace detail
+
+//! Walks marshaled data as a particular type, throwing the same
+//! exceptions xdr::xdr_generic_get would if the data is malformed.
+//! Structs and unions generated by \c xdrc are traversed field by
+//! field without creating them.  Other class types, and any type with
+//! a \c validate method, are unmarshaled into a temporary object so
+//! that their checks run.  Note that \c validate functions declared
+//! outside a type (see xdr::validate) are not called, since there is
+//! no object to pass them.
+//!
+//! When \c Strict is \c false, only what is needed to find the end of
+//! a value is checked (bounds, size limits, and union discriminants),
+//! making this the skipping archive used by xdr::xdr_lazy.
+template<typename Base, bool Strict = true> struct xdr_generic_validate : Base {
+  using Base::get32;
+  using Base::skip_bytes;
+
+  const std::uint32_t *p_;
+  const std::uint32_t *const e_;
+
+  xdr_generic_validate(const void *start, const void *end)
+    : p_(reinterpret_cast<const std::uint32_t *>(start)),
+      e_(reinterpret_cast<const std::uint32_t *>(end)) {
+    assert(!(reinterpret_cast<intptr_t>(start) & 3));
+    if (reinterpret_cast<intptr_t>(end) & 3)
+      throw xdr_bad_message_size("xdr_generic_validate: message size not"
+                                 " multiple of 4");
+    assert(p_ <= e_);
+  }
+  explicit xdr_generic_validate(const msg_ptr &m)
+    : xdr_generic_validate(m->data(), m->end()) {}
+
+  void check(std::size_t n) const {
+    if (n > std::size_t(reinterpret_cast<const char *>(e_)
+			- reinterpret_cast<const char *>(p_)))
+      throw xdr_overflow("insufficient buffer space in xdr_generic_validate");
+  }
+
+  //! Consume the marshaled form of one \c T.
+  template<typename T> void value() {
+    using traits = xdr_traits<T>;
+    if constexpr (detail::skippable<T, Strict>()) {
+      check(traits::fixed_size);
+      p_ += traits::fixed_size / 4;
+    }
+    else if constexpr (detail::has_uint_type<T, std::uint32_t>::value)
+      read32<T>();
+    else if constexpr (detail::has_uint_type<T, std::uint64_t>::value) {
+      check(8);
+      p_ += 2;
+    }
+    else if constexpr (traits::is_bytes) {
+      std::uint32_t n;
+      if constexpr (traits::variable_nelem) {
+	check(4);
+	n = get32(p_);
+	T::check_size(n);
+      }
+      else
+	n = T::container_fixed_nelem;
+      check(n);
+      if constexpr (Strict)
+	skip_bytes(p_, n);
+      else
+	p_ += (std::size_t(n) + 3) / 4;
+    }
+    else {
+      if (!marshal_base::stack_limit--)
+	throw xdr_stack_overflow("stack overflow in xdr_generic_validate");
+      if constexpr (traits::is_container)
+	container<T>();
+      else if constexpr (traits::is_struct && detail::has_field_info<traits>::value
+			 && (!Strict || !detail::has_validate_method<T>::value))
+	fields<traits>();
+      else if constexpr (traits::is_union && detail::has_mem_ptr<T>::value
+			 && (!Strict || !detail::has_validate_method<T>::value))
+	union_value<T>();
+      else
+	materialize<T>();
+      ++marshal_base::stack_limit;
+    }
+  }
+
+  void done() {
+    if (p_ != e_)
+      throw xdr_bad_message_size("validation did not consume whole message");
+  }
+
+private:
+  template<typename T> T read32() {
+    check(4);
+    T t = xdr_traits<T>::from_uint(get32(p_));
+    if constexpr (Strict && xdr_traits<T>::is_enum)
+      validate_enum<T>::validate(t);
+    return t;
+  }
+
+  template<typename T> void container() {
+    using V = typename T::value_type;
+    std::uint32_t n;
+    if constexpr (xdr_traits<T>::variable_nelem) {
+      check(4);
+      n = get32(p_);
+      T::check_size(n);
+    }
+    else
+      n = T::container_fixed_nelem;
+    if constexpr (detail::skippable<V, Strict>()) {
+      check(std::size_t(n) * xdr_traits<V>::fixed_size);
+      p_ += std::size_t(n) * xdr_traits<V>::fixed_size / 4;
+    }
+    else
+      for (std::uint32_t i = 0; i < n; ++i)
+	value<V>();
+  }
+
+  template<typename S> void fields() {
+    if constexpr (detail::has_field_info<S>::value) {
+      value<typename S::field_info::field_type>();
+      fields<typename S::next_field>();
+    }
+  }
+
+  template<typename T> void union_value() {
+    using traits = xdr_traits<T>;
+    using disc_t = std::decay_t<typename traits::discriminant_type>;
+    auto which = static_cast<typename traits::case_type>(read32<disc_t>());
+    if (T::_xdr_field_number(which) < 0)
+      throw xdr_bad_discriminant("bad discriminant in xdr_generic_validate");
+    T::_xdr_with_mem_ptr(detail::field_validator, which, *this);
+  }
+
+  template<typename T> void materialize() {
+    T t;
+    xdr_generic_get<Base> g(p_, e_);
+    g.stack_limit = marshal_base::stack_limit;
+    xdr_traits<T>::load(g, t);
+    p_ = g.p_;
+  }
+};
+
+#if XDRPP_WORDS_BIGENDIAN
+using xdr_validator = xdr_generic_validate<marshal_noswap>;
+#else // !XDRPP_WORDS_BIGENDIAN
+//! Validator for data in RFC4506 big-endian order.
+using xdr_validator = xdr_generic_validate<marshal_swap>;
+#endif // !XDRPP_WORDS_BIGENDIAN
+
+//! Check that the buffer from \c start to \c end holds one marshaled
+//! value of each type in \c Args, and nothing else.  Throws what
+//! xdr::xdr_from_msg would on malformed input.
+template<typename...Args> void
+xdr_check(const void *start, const void *end)
+{
+  xdr_validator v(start, end);
+  (v.template value<Args>(), ...);
+  v.done();
+}
+
+//! Returns \c true if xdr::xdr_from_msg would accept \c m as a series
+//! of values of types \c Args, without unmarshaling anything.
+template<typename...Args> bool
+xdr_validate(const msg_ptr &m)
+{
+  try {
+    xdr_check<Args...>(m->data(), m->end());
+    return true;
+  }
+  catch (const xdr_runtime_error &) {
+    return false;
+  }
+}
+
+}
+
+#endif // !_XDRPP_VALIDATE_H_HEADER_INCLUDED_